@@ -0,0 +1,197 @@
+#include "makemore/corpus.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+namespace makemore {
+
+namespace {
+
+std::runtime_error Error(const std::filesystem::path& path,
+                         const std::string& message) {
+  return std::runtime_error(path.string() + ": " + message);
+}
+
+// The number of shards to split `pairs` bigrams into.
+size_t Shards(size_t pairs, const micrograd::ThreadPool& pool) {
+  // Don't bother waking up the pool for a small corpus.
+  constexpr size_t kMinShardSize = 1 << 16;
+  return std::clamp<size_t>(pairs / kMinShardSize, 1, pool.size());
+}
+
+}  // namespace
+
+Corpus Corpus::Load(const std::filesystem::path& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw Error(path, std::strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    throw Error(path, std::strerror(error));
+  }
+  Corpus corpus;
+  size_t length = st.st_size;
+  if (length == 0) {
+    close(fd);
+    return corpus;
+  }
+  void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  int error = errno;
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw Error(path, std::strerror(error));
+  }
+  madvise(data, length, MADV_SEQUENTIAL);
+  // Every character but the newlines becomes a token.
+  corpus.tokens_.reserve(length + 1);
+  const char* begin = static_cast<const char*>(data);
+  const char* end = begin + length;
+  try {
+    // Like `std::getline`, a trailing newline does not start another word.
+    while (begin != end) {
+      const char* newline =
+          static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+      const char* word_end = newline != nullptr ? newline : end;
+      corpus.Append(begin, word_end);
+      begin = newline != nullptr ? newline + 1 : end;
+    }
+  } catch (const std::exception& e) {
+    munmap(data, length);
+    throw Error(path, e.what());
+  }
+  munmap(data, length);
+  return corpus;
+}
+
+Corpus Corpus::FromWords(std::span<const std::string> words) {
+  Corpus corpus;
+  for (const std::string& word : words) {
+    corpus.Append(word.data(), word.data() + word.size());
+  }
+  return corpus;
+}
+
+Corpus Corpus::Subset(std::span<const size_t> indices) const {
+  Corpus corpus;
+  for (size_t i : indices) {
+    // Each word already ends with the separator, so only skip the one it
+    // starts with.
+    std::span<const uint8_t> tokens = word(i).subspan(1);
+    corpus.tokens_.insert(corpus.tokens_.end(), tokens.begin(), tokens.end());
+    corpus.starts_.push_back(corpus.tokens_.size() - 1);
+  }
+  return corpus;
+}
+
+void Corpus::Append(const char* begin, const char* end) {
+  for (const char* c = begin; c != end; ++c) {
+    if (*c < 'a' || *c > 'z') {
+      throw std::invalid_argument("words must only have lowercase letters");
+    }
+    tokens_.push_back(*c - kSpecial);
+  }
+  tokens_.push_back(0);
+  starts_.push_back(tokens_.size() - 1);
+}
+
+Split SplitCorpus(const Corpus& corpus, uint64_t seed) {
+  std::vector<size_t> order(corpus.number_of_words());
+  std::iota(order.begin(), order.end(), 0);
+  std::mt19937_64 rng(seed);
+  std::shuffle(order.begin(), order.end(), rng);
+  size_t train = order.size() * 8 / 10;
+  size_t dev = order.size() * 9 / 10;
+  std::span<const size_t> words = order;
+  return {
+      .train = corpus.Subset(words.subspan(0, train)),
+      .dev = corpus.Subset(words.subspan(train, dev - train)),
+      .test = corpus.Subset(words.subspan(dev)),
+  };
+}
+
+Contexts BuildContexts(const Corpus& corpus, size_t block_size) {
+  Contexts contexts = {.block_size = block_size};
+  // Every token but the one the stream starts with is the target of one
+  // example.
+  size_t n = corpus.tokens().size() - 1;
+  contexts.contexts.reserve(n * block_size);
+  contexts.targets.reserve(n);
+  for (size_t i = 0; i < corpus.number_of_words(); ++i) {
+    std::span<const uint8_t> word = corpus.word(i);
+    for (size_t j = 1; j < word.size(); ++j) {
+      // The context is the `block_size` tokens before `j`, where anything
+      // before the start of the word is the special token.
+      for (size_t k = j; k < j + block_size; ++k) {
+        contexts.contexts.push_back(k >= block_size ? word[k - block_size] : 0);
+      }
+      contexts.targets.push_back(word[j]);
+    }
+  }
+  return contexts;
+}
+
+BigramCounts CountBigrams(std::span<const uint8_t> tokens,
+                          micrograd::ThreadPool& pool) {
+  size_t pairs = tokens.size() < 2 ? 0 : tokens.size() - 1;
+  size_t shards = Shards(pairs, pool);
+  std::vector<BigramCounts> counts(shards);
+  pool.ParallelFor(shards, [&](size_t shard) {
+    // Count into a local table, so shards never share a cache line.
+    BigramCounts local = {};
+    size_t end = pairs * (shard + 1) / shards;
+    for (size_t i = pairs * shard / shards; i < end; ++i) {
+      ++local[tokens[i] * kVocabularySize + tokens[i + 1]];
+    }
+    counts[shard] = local;
+  });
+  BigramCounts total = {};
+  for (const BigramCounts& shard : counts) {
+    for (size_t i = 0; i < total.size(); ++i) {
+      total[i] += shard[i];
+    }
+  }
+  return total;
+}
+
+double BigramLogLikelihood(std::span<const uint8_t> tokens,
+                           std::span<const float> probabilities,
+                           micrograd::ThreadPool& pool) {
+  if (probabilities.size() != kVocabularySize * kVocabularySize) {
+    throw std::invalid_argument("expected a probability for every bigram");
+  }
+  std::array<float, kVocabularySize * kVocabularySize> log_probabilities;
+  for (size_t i = 0; i < log_probabilities.size(); ++i) {
+    log_probabilities[i] = std::log(probabilities[i]);
+  }
+  size_t pairs = tokens.size() < 2 ? 0 : tokens.size() - 1;
+  size_t shards = Shards(pairs, pool);
+  std::vector<double> sums(shards);
+  pool.ParallelFor(shards, [&](size_t shard) {
+    double sum = 0.0;
+    size_t end = pairs * (shard + 1) / shards;
+    for (size_t i = pairs * shard / shards; i < end; ++i) {
+      sum += log_probabilities[tokens[i] * kVocabularySize + tokens[i + 1]];
+    }
+    sums[shard] = sum;
+  });
+  double total = 0.0;
+  for (double sum : sums) {
+    total += sum;
+  }
+  return total;
+}
+
+}  // namespace makemore
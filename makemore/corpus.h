@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "micrograd/thread_pool.h"
+
+namespace makemore {
+
+// The token that marks the start and the end of a word. Tokens are the
+// characters of the alphabet, offset so that this is zero.
+constexpr char kSpecial = '`';
+constexpr size_t kVocabularySize = 27;
+
+static_assert('a' - kSpecial == 1 && 'z' - kSpecial == kVocabularySize - 1);
+
+/**
+ * A list of words encoded once into a compact stream of tokens.
+ *
+ * The stream starts with the special token and every word is followed by it,
+ * so the bigrams of all the words (including the ones that start and end a
+ * word) are exactly the pairs of consecutive tokens in the stream.
+ */
+class Corpus {
+ public:
+  // One word per line. The file is memory mapped and encoded in a single
+  // pass, without splitting it into strings first.
+  static Corpus Load(const std::filesystem::path& path);
+  static Corpus FromWords(std::span<const std::string> words);
+
+  std::span<const uint8_t> tokens() const { return tokens_; }
+
+  // The number of words, and the range of tokens that make up each of them,
+  // including the special token on either side.
+  size_t number_of_words() const { return starts_.size() - 1; }
+  std::span<const uint8_t> word(size_t i) const {
+    return std::span(tokens_).subspan(starts_[i],
+                                      starts_[i + 1] - starts_[i] + 1);
+  }
+
+  // A corpus of the words at `indices`, in that order.
+  Corpus Subset(std::span<const size_t> indices) const;
+
+ private:
+  Corpus() = default;
+
+  // Append the (lowercase) characters of a word.
+  void Append(const char* begin, const char* end);
+
+  std::vector<uint8_t> tokens_ = {0};
+  // The offset of the special token before each word, and of the one after
+  // the last word.
+  std::vector<size_t> starts_ = {0};
+};
+
+// A random split of the words of a corpus, for training a model on one part
+// and evaluating it on the others.
+struct Split {
+  Corpus train;
+  Corpus dev;
+  Corpus test;
+};
+
+// Shuffle the words with `seed` and split them 80%, 10%, 10%.
+Split SplitCorpus(const Corpus& corpus, uint64_t seed);
+
+// The examples for a model that predicts each token of a word (and the end of
+// the word) from the `block_size` tokens before it, padded with the special
+// token at the start of the word.
+struct Contexts {
+  size_t block_size;
+  // Row-major [number of examples x block_size].
+  std::vector<uint8_t> contexts;
+  std::vector<uint8_t> targets;
+};
+Contexts BuildContexts(const Corpus& corpus, size_t block_size);
+
+// The number of times each token is followed by each other token, as a
+// row-major [kVocabularySize x kVocabularySize] matrix.
+//
+// Each thread of `pool` counts a contiguous shard of the stream into its own
+// table, and the tables are added up at the end.
+using BigramCounts = std::array<int32_t, kVocabularySize * kVocabularySize>;
+BigramCounts CountBigrams(std::span<const uint8_t> tokens,
+                          micrograd::ThreadPool& pool);
+
+// The total log likelihood of the bigrams of `tokens` under a bigram model,
+// where `probabilities` is a row-major [kVocabularySize x kVocabularySize]
+// matrix of the probability of each token following each other token.
+//
+// This takes the log of the table once, and then gathers from it and adds up
+// one entry per bigram, in shards across `pool` like `CountBigrams`. The
+// shards are added in order, so the result only depends on the number of
+// threads.
+double BigramLogLikelihood(std::span<const uint8_t> tokens,
+                           std::span<const float> probabilities,
+                           micrograd::ThreadPool& pool);
+
+}  // namespace makemore
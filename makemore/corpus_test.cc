@@ -0,0 +1,161 @@
+#include "makemore/corpus.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace makemore {
+
+namespace {
+
+// The counts of the bigrams of `words`, the slow way.
+BigramCounts Reference(const std::vector<std::string>& words) {
+  BigramCounts counts = {};
+  for (const auto& word : words) {
+    for (ssize_t i = -1; i < ssize_t(word.size()); ++i) {
+      char a = i >= 0 ? word[i] : kSpecial;
+      size_t j = i + 1;
+      char b = j < word.size() ? word[j] : kSpecial;
+      ++counts[(a - kSpecial) * kVocabularySize + (b - kSpecial)];
+    }
+  }
+  return counts;
+}
+
+}  // namespace
+
+TEST(MakemoreCorpus, Encode) {
+  std::vector<std::string> words = {"emma", "", "bo"};
+  Corpus corpus = Corpus::FromWords(words);
+  std::vector<uint8_t> expected = {0, 5, 13, 13, 1, 0, 0, 2, 15, 0};
+  EXPECT_EQ(std::vector(corpus.tokens().begin(), corpus.tokens().end()),
+            expected);
+  ASSERT_EQ(corpus.number_of_words(), 3);
+  EXPECT_EQ(corpus.word(0).size(), 6);
+  EXPECT_EQ(corpus.word(1).size(), 2);
+  EXPECT_EQ(corpus.word(2).front(), 0);
+  EXPECT_EQ(corpus.word(2)[1], 2);
+  EXPECT_EQ(corpus.word(2).back(), 0);
+
+  EXPECT_THROW(Corpus::FromWords(std::vector<std::string>{"Emma"}),
+               std::invalid_argument);
+}
+
+TEST(MakemoreCorpus, Load) {
+  std::filesystem::path path =
+      std::filesystem::path(testing::TempDir()) / "names.txt";
+  std::ofstream(path) << "emma\n\nbo\n";
+  Corpus corpus = Corpus::Load(path);
+  Corpus expected =
+      Corpus::FromWords(std::vector<std::string>{"emma", "", "bo"});
+  EXPECT_TRUE(std::ranges::equal(corpus.tokens(), expected.tokens()));
+  EXPECT_EQ(corpus.number_of_words(), 3);
+
+  // Without the trailing newline.
+  std::ofstream(path) << "emma\n\nbo";
+  EXPECT_TRUE(
+      std::ranges::equal(Corpus::Load(path).tokens(), expected.tokens()));
+
+  EXPECT_THROW(Corpus::Load(path.string() + ".missing"), std::runtime_error);
+}
+
+TEST(MakemoreCorpus, CountBigrams) {
+  std::vector<std::string> words;
+  for (size_t i = 0; i < 50000; ++i) {
+    std::string word;
+    for (size_t j = 0; j < i % 9; ++j) {
+      word.push_back('a' + (i * 7 + j * 13) % 26);
+    }
+    words.push_back(word);
+  }
+  Corpus corpus = Corpus::FromWords(words);
+  for (size_t threads : {1, 3, 8}) {
+    micrograd::ThreadPool pool(threads);
+    EXPECT_EQ(CountBigrams(corpus.tokens(), pool), Reference(words));
+  }
+}
+
+TEST(MakemoreCorpus, Split) {
+  std::vector<std::string> words;
+  for (size_t i = 0; i < 100; ++i) {
+    words.push_back(std::string(1 + i % 5, 'a' + i % 26));
+  }
+  Corpus corpus = Corpus::FromWords(words);
+  std::vector<size_t> indices = {3, 1};
+  Corpus subset = corpus.Subset(indices);
+  EXPECT_TRUE(std::ranges::equal(
+      subset.tokens(),
+      Corpus::FromWords(std::vector<std::string>{words[3], words[1]})
+          .tokens()));
+
+  Split split = SplitCorpus(corpus, /*seed=*/1);
+  EXPECT_EQ(split.train.number_of_words(), 80);
+  EXPECT_EQ(split.dev.number_of_words(), 10);
+  EXPECT_EQ(split.test.number_of_words(), 10);
+  // Every word ends up in exactly one part.
+  EXPECT_EQ(split.train.tokens().size() + split.dev.tokens().size() +
+                split.test.tokens().size(),
+            corpus.tokens().size() + 2);
+  Split same = SplitCorpus(corpus, /*seed=*/1);
+  EXPECT_TRUE(std::ranges::equal(same.dev.tokens(), split.dev.tokens()));
+}
+
+TEST(MakemoreCorpus, BigramLogLikelihood) {
+  std::vector<std::string> words;
+  for (size_t i = 0; i < 50000; ++i) {
+    words.push_back(std::string(i % 4, 'a' + (i * 5) % 26));
+  }
+  Corpus corpus = Corpus::FromWords(words);
+  micrograd::ThreadPool pool(4);
+  BigramCounts counts = CountBigrams(corpus.tokens(), pool);
+  std::vector<float> probabilities(counts.size());
+  for (size_t i = 0; i < kVocabularySize; ++i) {
+    float total = 0;
+    for (size_t j = 0; j < kVocabularySize; ++j) {
+      total += counts[i * kVocabularySize + j] + 1;
+    }
+    for (size_t j = 0; j < kVocabularySize; ++j) {
+      probabilities[i * kVocabularySize + j] =
+          (counts[i * kVocabularySize + j] + 1) / total;
+    }
+  }
+  double expected = 0.0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    expected += counts[i] * std::log(probabilities[i]);
+  }
+  double actual = BigramLogLikelihood(corpus.tokens(), probabilities, pool);
+  EXPECT_NEAR(actual, expected, 1e-6 * std::abs(expected));
+  micrograd::ThreadPool single(1);
+  EXPECT_NEAR(BigramLogLikelihood(corpus.tokens(), probabilities, single),
+              expected, 1e-6 * std::abs(expected));
+
+  EXPECT_THROW(BigramLogLikelihood(corpus.tokens(), {{0.5}}, pool),
+               std::invalid_argument);
+}
+
+TEST(MakemoreCorpus, BuildContexts) {
+  Corpus corpus = Corpus::FromWords(std::vector<std::string>{"emma", "bo"});
+  Contexts contexts = BuildContexts(corpus, 3);
+  EXPECT_EQ(contexts.block_size, 3);
+  std::vector<uint8_t> expected_contexts = {
+      0,  0,  0,   // -> e
+      0,  0,  5,   // -> m
+      0,  5,  13,  // -> m
+      5,  13, 13,  // -> a
+      13, 13, 1,   // -> end
+      0,  0,  0,   // -> b
+      0,  0,  2,   // -> o
+      0,  2,  15,  // -> end
+  };
+  std::vector<uint8_t> expected_targets = {5, 13, 13, 1, 0, 2, 15, 0};
+  EXPECT_EQ(contexts.contexts, expected_contexts);
+  EXPECT_EQ(contexts.targets, expected_targets);
+}
+
+}  // namespace makemore
@@ -1,93 +1,78 @@
 #include <torch/torch.h>
 
-#include <filesystem>
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
 #include "absl/strings/str_format.h"
+#include "makemore/corpus.h"
+#include "makemore/sampler.h"
+#include "micrograd/thread_pool.h"
 
-constexpr char kSpecial = '`';
+using makemore::Corpus;
 
-static_assert('a' - kSpecial == 1);
-
-std::vector<std::string> ReadNames(std::filesystem::path path) {
-  std::ifstream stream(path);
-  std::string name;
-  std::vector<std::string> names;
-  while (std::getline(stream, name)) {
-    names.push_back(name);
-  }
-  return names;
+torch::Tensor MakeBigrams(const Corpus& corpus, micrograd::ThreadPool& pool) {
+  makemore::BigramCounts counts = makemore::CountBigrams(corpus.tokens(), pool);
+  return torch::from_blob(counts.data(), {27, 27}, torch::dtype<int32_t>())
+      .clone();
 }
 
-torch::Tensor MakeBigrams(const std::vector<std::string>& words) {
-  auto counts = torch::zeros({27, 27}, torch::dtype<int32_t>());
-  for (const auto& word : words) {
-    for (ssize_t i = -1; i < ssize_t(word.size()); ++i) {
-      char a = i >= 0 ? word[i] : kSpecial;
-      int j = i + 1;
-      char b = j < word.size() ? word[j] : kSpecial;
-      counts[a - kSpecial][b - kSpecial] += 1;
-    }
-  }
-  return counts;
+// The probability of each bigram under the counting model, with add-one
+// smoothing.
+torch::Tensor CountModel(const Corpus& corpus, micrograd::ThreadPool& pool) {
+  auto P = (MakeBigrams(corpus, pool) + 1).toType(torch::kF32);
+  P /= P.sum(/*dim=*/1, /*keepdim=*/true);
+  return P.contiguous();
 }
 
-void Sample(const std::vector<std::string>& words, torch::Tensor N) {
-  auto P = (N + 1).toType(torch::kF32);
-  P /= P.sum(/*dim=*/1, /*keepdim=*/true);
-  auto g = torch::make_generator<torch::CPUGeneratorImpl>();
-  g.set_current_seed(2147483647);
-  for (int i = 0; i < 50; ++i) {
-    std::string out;
-    int ix = 0;
-    for (;;) {
-      auto p = P[ix];
-      ix = torch::multinomial(p,
-                              /*num_samples=*/1,
-                              /*replacement=*/true,
-                              /*generator=*/g)
-               .item()
-               .toInt();
-      if (ix == 0) {
-        break;
-      }
-      out.push_back(kSpecial + ix);
-    }
-    absl::PrintF("%v\n", out);
+void Sample(torch::Tensor P, size_t count, uint64_t seed,
+            micrograd::ThreadPool& pool) {
+  auto start = std::chrono::steady_clock::now();
+  makemore::BigramSampler sampler(
+      std::span<const float>(P.data_ptr<float>(), P.numel()));
+  std::vector<std::string> words = sampler.Sample(count, seed, pool);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::string out;
+  for (const std::string& word : words) {
+    out += word;
+    out += '\n';
   }
+  absl::PrintF("%s", out);
+  absl::PrintF("sampled %d names in %.3fs\n", count, elapsed.count());
+}
 
-  auto log_likelihood = torch::zeros({1});
-  float n = 0;
-  for (const auto& word : words) {
-    for (ssize_t i = -1; i < ssize_t(word.size()); ++i) {
-      char a = i >= 0 ? word[i] : kSpecial;
-      int j = i + 1;
-      char b = j < word.size() ? word[j] : kSpecial;
-      auto prob = P[a - kSpecial][b - kSpecial];
-      auto logprob = torch::log(prob);
-      log_likelihood += logprob;
-      n += 1;
-    }
-  }
-  absl::PrintF("%v\n", absl::FormatStreamed(log_likelihood));
-  absl::PrintF("%v\n", absl::FormatStreamed(-log_likelihood));
-  absl::PrintF("%v\n", absl::FormatStreamed((-log_likelihood) / n));
+// Print the negative log likelihood of the bigrams of `corpus` under the
+// bigram probabilities `P`, which can come from either model.
+void Evaluate(std::string_view name, torch::Tensor P, const Corpus& corpus,
+              micrograd::ThreadPool& pool) {
+  P = P.toType(torch::kF32).contiguous();
+  double log_likelihood = makemore::BigramLogLikelihood(
+      corpus.tokens(), std::span<const float>(P.data_ptr<float>(), P.numel()),
+      pool);
+  size_t n = corpus.tokens().size() - 1;
+  absl::PrintF("%s: log likelihood %.1f, nll %.1f, mean nll %.4f over %d "
+               "bigrams\n",
+               name, log_likelihood, -log_likelihood, -log_likelihood / n, n);
 }
 
-void TrainNN(std::span<std::string> words) {
-  std::vector<int32_t> xs_vec;
-  std::vector<int32_t> ys_vec;
-  for (const auto& word : words) {
-    for (ssize_t i = -1; i < ssize_t(word.size()); ++i) {
-      char a = i >= 0 ? word[i] : kSpecial;
-      int j = i + 1;
-      char b = j < word.size() ? word[j] : kSpecial;
-      xs_vec.push_back(a - kSpecial);
-      ys_vec.push_back(b - kSpecial);
-    }
-  }
+// Train a single layer network on the bigrams of `corpus`, returning the
+// probability of each bigram under it.
+torch::Tensor TrainNN(const Corpus& corpus) {
+  // Every token is the input for the one after it.
+  std::span<const uint8_t> tokens = corpus.tokens();
+  std::vector<int64_t> xs_vec(tokens.begin(), tokens.end() - 1);
+  std::vector<int64_t> ys_vec(tokens.begin() + 1, tokens.end());
   auto g = torch::make_generator<torch::CPUGeneratorImpl>();
   g.set_current_seed(2147483647);
 
@@ -96,28 +81,216 @@ void TrainNN(std::span<std::string> words) {
   auto num = xs.numel();
   absl::PrintF("number of examples: %d\n", num);
   auto W = torch::randn({27, 27}, g, torch::requires_grad());
+  auto start = std::chrono::steady_clock::now();
   for (int k = 0; k < 50; ++k) {
-    auto xenc = torch::one_hot(xs, /*num_classes=*/27).toType(torch::kF32);
-    auto logits = xenc.matmul(W);
-    auto counts = logits.exp();
-    torch::Tensor probs = counts / counts.sum(1, /*keepdim=*/true);
-    auto loss = -torch::index_select(
-                     torch::index_select(probs, 0, torch::arange(num)), 1, ys)
-                     .log()
-                     .mean();
+    // Multiplying a one hot encoding by `W` just selects its rows, so gather
+    // them directly: [num x 27].
+    auto logits = W.index_select(0, xs);
+    // The mean negative log likelihood of the next characters, which only
+    // reads the log probability of `ys` out of each row instead of
+    // normalizing the whole matrix first.
+    auto loss = torch::nn::functional::cross_entropy(logits, ys);
     absl::PrintF("loss: %v\n", absl::FormatStreamed(loss));
 
     W.mutable_grad().reset();
     loss.backward();
     W.data() += -5.0 * W.grad();
   }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  absl::PrintF("trained in %.2fs\n", elapsed.count());
+  // The logits of a token are its row of `W`.
+  return torch::softmax(W.detach(), /*dim=*/1);
+}
+
+// The hyperparameters of `MLP`.
+struct MLPOptions {
+  // The number of previous characters the model sees.
+  int64_t block_size;
+  // The width of the embedding of each character.
+  int64_t embedding;
+  int64_t hidden;
+  int64_t batch_size;
+  int64_t steps;
+  float learning_rate;
+};
+
+// A character level language model in the style of Bengio et al. 2003: the
+// embeddings of the previous `block_size` characters are concatenated and fed
+// through a tanh hidden layer into a softmax over the next character.
+struct MLP {
+  torch::Tensor C;   // [27 x embedding]
+  torch::Tensor W1;  // [block_size * embedding x hidden]
+  torch::Tensor b1;  // [hidden]
+  torch::Tensor W2;  // [hidden x 27]
+  torch::Tensor b2;  // [27]
+
+  // The logits of the next character for a [batch x block_size] tensor of
+  // contexts.
+  torch::Tensor Logits(const torch::Tensor& contexts) const {
+    auto emb = C.index_select(0, contexts.view({-1}))
+                   .view({contexts.size(0), -1});
+    auto h = torch::tanh(emb.matmul(W1) + b1);
+    return h.matmul(W2) + b2;
+  }
+
+  std::vector<torch::Tensor> parameters() const { return {C, W1, b1, W2, b2}; }
+};
+
+// The examples of `corpus` as a [n x block_size] tensor of contexts and a [n]
+// tensor of the characters that follow them.
+std::pair<torch::Tensor, torch::Tensor> ContextTensors(const Corpus& corpus,
+                                                       int64_t block_size) {
+  makemore::Contexts contexts = makemore::BuildContexts(corpus, block_size);
+  int64_t n = contexts.targets.size();
+  auto X = torch::from_blob(contexts.contexts.data(), {n, block_size},
+                            torch::dtype(torch::kUInt8))
+               .toType(torch::kInt64);
+  auto Y = torch::from_blob(contexts.targets.data(), {n},
+                            torch::dtype(torch::kUInt8))
+               .toType(torch::kInt64);
+  return {X, Y};
+}
+
+// Train an `MLP` with mini-batch SGD. The contexts are built once up front,
+// and each step gathers a random batch of them, so a step costs the same no
+// matter how large the corpus is.
+MLP TrainMLP(const Corpus& corpus, const MLPOptions& options) {
+  auto [X, Y] = ContextTensors(corpus, options.block_size);
+  int64_t n = X.size(0);
+  absl::PrintF("number of examples: %d\n", n);
+  auto g = torch::make_generator<torch::CPUGeneratorImpl>();
+  g.set_current_seed(2147483647);
+  int64_t inputs = options.block_size * options.embedding;
+  MLP mlp = {
+      .C = torch::randn({27, options.embedding}, g),
+      // Scaled so the pre-activations of the tanh start out with roughly
+      // unit variance.
+      .W1 = torch::randn({inputs, options.hidden}, g) *
+            (5.0 / 3.0 / std::sqrt(inputs)),
+      .b1 = torch::randn({options.hidden}, g) * 0.01,
+      // Small, so the initial predictions are close to uniform.
+      .W2 = torch::randn({options.hidden, 27}, g) * 0.01,
+      .b2 = torch::zeros({27}),
+  };
+  for (torch::Tensor p : mlp.parameters()) {
+    p.requires_grad_();
+  }
+  auto start = std::chrono::steady_clock::now();
+  int64_t examples = 0;
+  for (int64_t k = 0; k < options.steps; ++k) {
+    auto ix = torch::randint(n, {options.batch_size}, g);
+    auto logits = mlp.Logits(X.index_select(0, ix));
+    auto loss = torch::nn::functional::cross_entropy(logits,
+                                                     Y.index_select(0, ix));
+    for (torch::Tensor p : mlp.parameters()) {
+      p.mutable_grad().reset();
+    }
+    loss.backward();
+    // Decay the learning rate for the last quarter of training.
+    float learning_rate = k < options.steps * 3 / 4
+                              ? options.learning_rate
+                              : options.learning_rate / 10;
+    for (torch::Tensor p : mlp.parameters()) {
+      p.data() += -learning_rate * p.grad();
+    }
+    examples += options.batch_size;
+    if ((k + 1) % 1000 == 0 || k + 1 == options.steps) {
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      absl::PrintF("step %d loss: %v (%.0f examples/sec)\n", k + 1,
+                   absl::FormatStreamed(loss), examples / elapsed.count());
+      start = std::chrono::steady_clock::now();
+      examples = 0;
+    }
+  }
+  return mlp;
+}
+
+// Print the mean negative log likelihood of the examples of `corpus` under
+// `mlp`.
+void EvaluateMLP(std::string_view name, const MLP& mlp, const Corpus& corpus,
+                 int64_t block_size) {
+  torch::NoGradGuard no_grad;
+  auto [X, Y] = ContextTensors(corpus, block_size);
+  int64_t n = X.size(0);
+  // Evaluate in chunks, so the hidden activations of the whole corpus never
+  // have to be in memory at once.
+  constexpr int64_t kChunkSize = 1 << 16;
+  double nll = 0.0;
+  for (int64_t begin = 0; begin < n; begin += kChunkSize) {
+    int64_t size = std::min(kChunkSize, n - begin);
+    auto logits = mlp.Logits(X.narrow(0, begin, size));
+    nll += torch::nn::functional::cross_entropy(
+               logits, Y.narrow(0, begin, size),
+               torch::nn::functional::CrossEntropyFuncOptions().reduction(
+                   torch::kSum))
+               .item<double>();
+  }
+  absl::PrintF("%s: mean nll %.4f over %d examples\n", name, nll / n, n);
 }
 
 ABSL_FLAG(std::string, names_file, "makemore/names.txt", "input names file");
+ABSL_FLAG(std::string, model, "nn",
+          "the bigram model to build: 'counts' counts the bigrams of the "
+          "corpus and samples from them, 'nn' trains a single layer network, "
+          "'mlp' trains a model on the previous --block_size characters");
+ABSL_FLAG(size_t, samples, 50,
+          "the number of names to sample from the counting model");
+ABSL_FLAG(uint64_t, seed, 2147483647, "the seed for sampling names");
+ABSL_FLAG(bool, split, false,
+          "train on 80% of the names and also evaluate on the other 10% dev "
+          "and 10% test splits, instead of training on all of them");
+ABSL_FLAG(int64_t, block_size, 3,
+          "the number of previous characters the mlp model sees");
+ABSL_FLAG(int64_t, embedding, 10,
+          "the width of the character embeddings of the mlp model");
+ABSL_FLAG(int64_t, hidden, 200, "the width of the hidden layer of the mlp");
+ABSL_FLAG(int64_t, batch_size, 32, "the mini-batch size for the mlp");
+ABSL_FLAG(int64_t, steps, 20000, "the number of steps to train the mlp for");
+ABSL_FLAG(float, learning_rate, 0.1, "the learning rate of the mlp");
+ABSL_FLAG(size_t, threads, std::thread::hardware_concurrency(),
+          "the number of threads to use");
 
-int main() {
-  auto names = ReadNames(absl::GetFlag(FLAGS_names_file));
-  // auto counts = MakeBigrams(names);
-  // Sample(names, std::move(counts));
-  TrainNN(names);
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  auto corpus = Corpus::Load(absl::GetFlag(FLAGS_names_file));
+  micrograd::ThreadPool pool(std::max<size_t>(absl::GetFlag(FLAGS_threads), 1));
+  std::optional<makemore::Split> split;
+  if (absl::GetFlag(FLAGS_split)) {
+    split = makemore::SplitCorpus(corpus, /*seed=*/42);
+  }
+  const Corpus& train = split ? split->train : corpus;
+  std::string model = absl::GetFlag(FLAGS_model);
+  if (model == "mlp") {
+    MLPOptions options = {
+        .block_size = absl::GetFlag(FLAGS_block_size),
+        .embedding = absl::GetFlag(FLAGS_embedding),
+        .hidden = absl::GetFlag(FLAGS_hidden),
+        .batch_size = absl::GetFlag(FLAGS_batch_size),
+        .steps = absl::GetFlag(FLAGS_steps),
+        .learning_rate = absl::GetFlag(FLAGS_learning_rate),
+    };
+    MLP mlp = TrainMLP(train, options);
+    EvaluateMLP("train", mlp, train, options.block_size);
+    if (split) {
+      EvaluateMLP("dev", mlp, split->dev, options.block_size);
+      EvaluateMLP("test", mlp, split->test, options.block_size);
+    }
+    return 0;
+  }
+  torch::Tensor P;
+  if (model == "counts") {
+    P = CountModel(train, pool);
+    Sample(P, absl::GetFlag(FLAGS_samples), absl::GetFlag(FLAGS_seed), pool);
+  } else if (model == "nn") {
+    P = TrainNN(train);
+  } else {
+    throw std::runtime_error("unknown model: " + model);
+  }
+  Evaluate("train", P, train, pool);
+  if (split) {
+    Evaluate("dev", P, split->dev, pool);
+    Evaluate("test", P, split->test, pool);
+  }
 }
@@ -0,0 +1,93 @@
+#include "makemore/sampler.h"
+
+#include <numeric>
+#include <stdexcept>
+
+#include "makemore/corpus.h"
+
+namespace makemore {
+
+AliasTable::AliasTable(std::span<const float> weights)
+    : probability_(weights.size()), alias_(weights.size()) {
+  size_t n = weights.size();
+  double total = 0.0;
+  for (float w : weights) {
+    if (!(w >= 0)) {
+      throw std::invalid_argument("weights must be non-negative");
+    }
+    total += w;
+  }
+  if (n == 0 || total <= 0) {
+    throw std::invalid_argument("weights must not all be zero");
+  }
+  // Scale the weights so the average column holds exactly 1, then repeatedly
+  // top up a column that holds less than 1 with the excess of one that holds
+  // more, which becomes its alias.
+  std::vector<double> scaled(n);
+  std::vector<uint32_t> small;
+  std::vector<uint32_t> large;
+  for (size_t i = 0; i < n; ++i) {
+    scaled[i] = weights[i] * n / total;
+    (scaled[i] < 1.0 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    uint32_t s = small.back();
+    small.pop_back();
+    uint32_t l = large.back();
+    probability_[s] = scaled[s];
+    alias_[s] = l;
+    scaled[l] -= 1.0 - scaled[s];
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // What is left over is full, up to rounding errors.
+  for (uint32_t i : large) {
+    probability_[i] = 1.0;
+    alias_[i] = i;
+  }
+  for (uint32_t i : small) {
+    probability_[i] = 1.0;
+    alias_[i] = i;
+  }
+}
+
+BigramSampler::BigramSampler(std::span<const float> probabilities) {
+  if (probabilities.size() != kVocabularySize * kVocabularySize) {
+    throw std::invalid_argument("expected a probability for every bigram");
+  }
+  tables_.reserve(kVocabularySize);
+  for (size_t i = 0; i < kVocabularySize; ++i) {
+    tables_.emplace_back(
+        probabilities.subspan(i * kVocabularySize, kVocabularySize));
+  }
+}
+
+std::string BigramSampler::Sample(std::mt19937_64& rng) const {
+  std::string word;
+  for (size_t token = tables_[0].Sample(rng); token != 0;
+       token = tables_[token].Sample(rng)) {
+    word.push_back(kSpecial + token);
+  }
+  return word;
+}
+
+std::vector<std::string> BigramSampler::Sample(
+    size_t count, uint64_t seed, micrograd::ThreadPool& pool) const {
+  std::vector<std::string> words(count);
+  size_t shards = pool.size();
+  pool.ParallelFor(shards, [&](size_t shard) {
+    std::seed_seq seq{static_cast<uint32_t>(seed),
+                      static_cast<uint32_t>(seed >> 32),
+                      static_cast<uint32_t>(shard)};
+    std::mt19937_64 rng(seq);
+    size_t end = count * (shard + 1) / shards;
+    for (size_t i = count * shard / shards; i < end; ++i) {
+      words[i] = Sample(rng);
+    }
+  });
+  return words;
+}
+
+}  // namespace makemore
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "micrograd/thread_pool.h"
+
+namespace makemore {
+
+/**
+ * Draws from a fixed discrete distribution in constant time, using Walker's
+ * alias method.
+ *
+ * The distribution over `n` outcomes is split into `n` equally likely
+ * columns, each holding at most two outcomes: the outcome of the column and
+ * its alias. A draw picks a column and then one of its two outcomes, which is
+ * one random number no matter how many outcomes there are.
+ */
+class AliasTable {
+ public:
+  // A distribution proportional to `weights`, which must be non-negative and
+  // not all zero.
+  explicit AliasTable(std::span<const float> weights);
+
+  size_t Sample(std::mt19937_64& rng) const {
+    uint64_t bits = rng();
+    // The high bits pick the column, and the low bits the outcome within it.
+    size_t column = ((bits >> 32) * probability_.size()) >> 32;
+    float u = static_cast<uint32_t>(bits) * 0x1p-32f;
+    return u < probability_[column] ? column : alias_[column];
+  }
+
+  size_t size() const { return probability_.size(); }
+
+ private:
+  // The probability of picking the column's own outcome over its alias.
+  std::vector<float> probability_;
+  std::vector<uint32_t> alias_;
+};
+
+// Generates words from a bigram model, one alias table per previous token.
+class BigramSampler {
+ public:
+  // `probabilities` is a row-major [kVocabularySize x kVocabularySize]
+  // matrix, where each row is the distribution of the token that follows a
+  // token.
+  explicit BigramSampler(std::span<const float> probabilities);
+
+  // Draw a single word.
+  std::string Sample(std::mt19937_64& rng) const;
+
+  // Draw `count` words across the threads of `pool`.
+  //
+  // The words are split into one contiguous shard per thread, and each shard
+  // has its own generator seeded from `seed` and the shard, so the result
+  // only depends on the seed and the number of threads.
+  std::vector<std::string> Sample(size_t count, uint64_t seed,
+                                  micrograd::ThreadPool& pool) const;
+
+ private:
+  std::vector<AliasTable> tables_;
+};
+
+}  // namespace makemore
@@ -0,0 +1,58 @@
+#include "makemore/sampler.h"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "makemore/corpus.h"
+
+namespace makemore {
+
+TEST(MakemoreSampler, AliasTable) {
+  std::vector<float> weights = {1, 0, 3, 4, 2};
+  AliasTable table(weights);
+  ASSERT_EQ(table.size(), weights.size());
+  std::mt19937_64 rng(1);
+  constexpr size_t kDraws = 1'000'000;
+  std::vector<size_t> counts(weights.size());
+  for (size_t i = 0; i < kDraws; ++i) {
+    ++counts[table.Sample(rng)];
+  }
+  EXPECT_EQ(counts[1], 0);
+  for (size_t i = 0; i < weights.size(); ++i) {
+    EXPECT_NEAR(counts[i] / double(kDraws), weights[i] / 10, 0.005) << i;
+  }
+
+  EXPECT_THROW(AliasTable(std::vector<float>{0, 0}), std::invalid_argument);
+  EXPECT_THROW(AliasTable(std::vector<float>{1, -1}), std::invalid_argument);
+  EXPECT_THROW(AliasTable(std::vector<float>{}), std::invalid_argument);
+}
+
+TEST(MakemoreSampler, BigramSampler) {
+  // After the start, 'a' or 'b' equally likely, then always the end.
+  std::vector<float> probabilities(kVocabularySize * kVocabularySize);
+  probabilities[1] = 0.5;
+  probabilities[2] = 0.5;
+  for (size_t i = 1; i < kVocabularySize; ++i) {
+    probabilities[i * kVocabularySize] = 1;
+  }
+  BigramSampler sampler(probabilities);
+  micrograd::ThreadPool pool(3);
+  std::vector<std::string> words = sampler.Sample(1000, /*seed=*/42, pool);
+  ASSERT_EQ(words.size(), 1000);
+  size_t a = 0;
+  for (const std::string& word : words) {
+    ASSERT_TRUE(word == "a" || word == "b") << word;
+    a += word == "a";
+  }
+  EXPECT_GT(a, 400);
+  EXPECT_LT(a, 600);
+  EXPECT_EQ(sampler.Sample(1000, /*seed=*/42, pool), words);
+  EXPECT_NE(sampler.Sample(1000, /*seed=*/43, pool), words);
+
+  EXPECT_THROW(BigramSampler(std::vector<float>(10, 1)),
+               std::invalid_argument);
+}
+
+}  // namespace makemore
@@ -0,0 +1,58 @@
+#include "micrograd/allocation_counter.h"
+
+#include <malloc.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace micrograd::allocation_counter {
+
+namespace {
+
+struct Counters {
+  std::atomic<size_t> allocations = 0;
+  std::atomic<size_t> allocated_bytes = 0;
+  std::atomic<size_t> live_bytes = 0;
+  std::atomic<size_t> peak_live_bytes = 0;
+};
+
+// Constant initialized, since allocations can happen before `main`.
+constinit Counters counters;
+
+}  // namespace
+
+size_t allocations() { return counters.allocations.load(); }
+size_t allocated_bytes() { return counters.allocated_bytes.load(); }
+size_t live_bytes() { return counters.live_bytes.load(); }
+size_t peak_live_bytes() { return counters.peak_live_bytes.load(); }
+void ResetPeak() { counters.peak_live_bytes.store(counters.live_bytes.load()); }
+
+}  // namespace micrograd::allocation_counter
+
+using micrograd::allocation_counter::counters;
+
+void* operator new(size_t size) {
+  counters.allocations.fetch_add(1, std::memory_order_relaxed);
+  counters.allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size)) {
+    // Live bytes count what malloc actually reserved, which is what `free`
+    // gives back.
+    size_t usable = malloc_usable_size(ptr);
+    size_t live =
+        counters.live_bytes.fetch_add(usable, std::memory_order_relaxed) +
+        usable;
+    size_t peak = counters.peak_live_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !counters.peak_live_bytes.compare_exchange_weak(
+                              peak, live, std::memory_order_relaxed)) {
+    }
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept {
+  counters.live_bytes.fetch_sub(malloc_usable_size(ptr),
+                                std::memory_order_relaxed);
+  std::free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
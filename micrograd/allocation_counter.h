@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Counts the heap allocations of the whole program, for the demo and the
+ * benchmarks to report how much memory the engines churn through.
+ *
+ * Linking this library replaces the global `operator new` and `operator
+ * delete` with versions that update the counters before calling `malloc` and
+ * `free`, so it should only be linked into binaries, never into a library.
+ */
+namespace micrograd::allocation_counter {
+
+// The number of allocations, and the bytes they requested, since the
+// program started.
+size_t allocations();
+size_t allocated_bytes();
+
+// The bytes that are allocated and not freed yet.
+size_t live_bytes();
+// The most bytes that were live at once since the last `ResetPeak`.
+size_t peak_live_bytes();
+// Start tracking the peak again from the bytes that are live now.
+void ResetPeak();
+
+}  // namespace micrograd::allocation_counter
@@ -0,0 +1,241 @@
+#include "micrograd/checkpoint.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace micrograd {
+
+namespace {
+
+constexpr char kMagic[8] = {'M', 'G', 'M', 'L', 'P', '\0', '\0', '\0'};
+constexpr uint32_t kVersion = 1;
+
+// Followed by the number of outputs of each layer as `uint64_t`s, and then
+// the parameter values.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t number_of_layers;
+  uint64_t number_of_inputs;
+};
+static_assert(sizeof(Header) == 24 && sizeof(Header) % alignof(float) == 0);
+
+std::runtime_error Error(const std::filesystem::path& path,
+                         const std::string& message) {
+  return std::runtime_error(path.string() + ": " + message);
+}
+
+// Serialize `model` into `out`, reusing its memory.
+void Serialize(const MLP& model, std::vector<char>& out) {
+  std::vector<size_t> outputs = model.number_of_outputs();
+  if (outputs.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::invalid_argument("too many layers");
+  }
+  std::span<const float> values = model.ParameterValues();
+  size_t shape_bytes = outputs.size() * sizeof(uint64_t);
+  out.resize(sizeof(Header) + shape_bytes + values.size_bytes());
+  Header header = {.version = kVersion,
+                   .number_of_layers = static_cast<uint32_t>(outputs.size()),
+                   .number_of_inputs = model.number_of_inputs()};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  char* p = out.data();
+  std::memcpy(p, &header, sizeof(header));
+  p += sizeof(header);
+  for (size_t output_size : outputs) {
+    uint64_t size = output_size;
+    std::memcpy(p, &size, sizeof(size));
+    p += sizeof(size);
+  }
+  std::memcpy(p, values.data(), values.size_bytes());
+}
+
+// Write `data` to a temporary file next to `path`, and rename it over `path`.
+void WriteFile(const std::filesystem::path& path, std::span<const char> data) {
+  std::filesystem::path temporary = path;
+  temporary += ".tmp";
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    throw Error(temporary, std::strerror(errno));
+  }
+  while (!data.empty()) {
+    ssize_t written = write(fd, data.data(), data.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      int error = errno;
+      close(fd);
+      throw Error(temporary, std::strerror(error));
+    }
+    data = data.subspan(written);
+  }
+  if (close(fd) != 0) {
+    throw Error(temporary, std::strerror(errno));
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    throw Error(path, error.message());
+  }
+}
+
+}  // namespace
+
+void SaveCheckpoint(const std::filesystem::path& path, const MLP& model) {
+  std::vector<char> data;
+  Serialize(model, data);
+  WriteFile(path, data);
+}
+
+MLP LoadCheckpoint(const std::filesystem::path& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw Error(path, std::strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    throw Error(path, std::strerror(error));
+  }
+  size_t length = st.st_size;
+  if (length < sizeof(Header)) {
+    close(fd);
+    throw Error(path, "not a checkpoint");
+  }
+  void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  int error = errno;
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw Error(path, std::strerror(error));
+  }
+  const auto* header = static_cast<const Header*>(data);
+  const auto* shape = reinterpret_cast<const uint64_t*>(header + 1);
+  std::string problem;
+  std::vector<size_t> outputs;
+  size_t parameters = 0;
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+    problem = "not a checkpoint";
+  } else if (header->version != kVersion) {
+    problem = "unsupported version " + std::to_string(header->version);
+  } else if ((length - sizeof(Header)) / sizeof(uint64_t) <
+             header->number_of_layers) {
+    problem = "size does not match the header";
+  } else {
+    // Add up the parameters of each layer, without overflowing on a corrupt
+    // shape.
+    size_t bytes = length - sizeof(Header) -
+                   header->number_of_layers * sizeof(uint64_t);
+    size_t available = bytes / sizeof(float);
+    uint64_t prev = header->number_of_inputs;
+    outputs.assign(shape, shape + header->number_of_layers);
+    for (uint64_t output_size : outputs) {
+      if (prev >= available ||
+          (output_size != 0 && prev + 1 > (available - parameters) /
+                                              output_size)) {
+        problem = "size does not match the header";
+        break;
+      }
+      parameters += (prev + 1) * output_size;
+      prev = output_size;
+    }
+    if (problem.empty() &&
+        (bytes % sizeof(float) != 0 || parameters != available)) {
+      problem = "size does not match the header";
+    }
+  }
+  if (!problem.empty()) {
+    munmap(data, length);
+    throw Error(path, problem);
+  }
+  const auto* values = reinterpret_cast<const float*>(shape + outputs.size());
+  MLP model(header->number_of_inputs, outputs);
+  std::memcpy(model.ParameterValues().data(), values,
+              parameters * sizeof(float));
+  munmap(data, length);
+  return model;
+}
+
+Checkpointer::Checkpointer(std::filesystem::path path)
+    : path_(std::move(path)), writer_([this] { Work(); }) {}
+
+Checkpointer::~Checkpointer() {
+  {
+    std::lock_guard lock(mu_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+}
+
+void Checkpointer::Save(const MLP& model) {
+  std::vector<char> buffer;
+  {
+    std::lock_guard lock(mu_);
+    if (error_) {
+      std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+    buffer = std::move(spare_);
+  }
+  Serialize(model, buffer);
+  {
+    std::lock_guard lock(mu_);
+    // A checkpoint that was never written is superseded by this one, and its
+    // buffer is reused for the next.
+    std::swap(pending_, buffer);
+    spare_ = std::move(buffer);
+    has_pending_ = true;
+  }
+  wake_.notify_one();
+}
+
+void Checkpointer::Wait() {
+  std::unique_lock lock(mu_);
+  done_.wait(lock, [this] { return !has_pending_ && !writing_; });
+  if (error_) {
+    std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+}
+
+void Checkpointer::Work() {
+  std::unique_lock lock(mu_);
+  while (true) {
+    wake_.wait(lock, [this] { return has_pending_ || stopping_; });
+    if (!has_pending_) {
+      return;
+    }
+    std::vector<char> buffer = std::move(pending_);
+    has_pending_ = false;
+    writing_ = true;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      WriteFile(path_, buffer);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    writing_ = false;
+    if (error) {
+      error_ = error;
+    }
+    if (spare_.capacity() < buffer.capacity()) {
+      spare_ = std::move(buffer);
+    }
+    done_.notify_all();
+  }
+}
+
+}  // namespace micrograd
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "micrograd/nn.h"
+
+namespace micrograd {
+
+// Save the shape and the parameter values of `model` to `path`.
+//
+// The file is a small header (a magic number, a version, the number of
+// inputs and the number of outputs of each layer) followed by the values of
+// `MLP::Parameters()` as raw floats, in the native byte order. It is built in
+// memory and written with a single sequential write to a temporary file,
+// which is then renamed over `path`, so a reader never sees a partial
+// checkpoint.
+void SaveCheckpoint(const std::filesystem::path& path, const MLP& model);
+
+// Load a model saved by `SaveCheckpoint`, throwing if `path` is not a valid
+// checkpoint.
+//
+// The file is memory mapped and its values are copied into the parameters of
+// the new model in one block, without parsing each of them.
+MLP LoadCheckpoint(const std::filesystem::path& path);
+
+/**
+ * Saves checkpoints of a model on a background thread, so a training loop can
+ * checkpoint periodically without waiting for the disk.
+ *
+ * `Save` only copies the parameter values into a buffer on the calling
+ * thread, which is a single `memcpy`, and hands it to the writer. If the
+ * writer is still busy with an earlier checkpoint, only the latest pending
+ * one is kept, so a slow disk skips checkpoints instead of stalling training.
+ */
+class Checkpointer {
+ public:
+  // Checkpoints are written to `path`, replacing the previous one.
+  explicit Checkpointer(std::filesystem::path path);
+  Checkpointer(const Checkpointer&) = delete;
+  Checkpointer& operator=(const Checkpointer&) = delete;
+  // Writes the pending checkpoint, if any, before returning.
+  ~Checkpointer();
+
+  // Snapshot the current values of `model` and write them in the background.
+  //
+  // If writing an earlier checkpoint failed, this rethrows its exception
+  // instead.
+  void Save(const MLP& model);
+
+  // Wait for the pending checkpoint to be written, and rethrow the exception
+  // of the last failed write, if any.
+  void Wait();
+
+ private:
+  void Work();
+
+  std::filesystem::path path_;
+  std::mutex mu_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  // The serialized checkpoint waiting to be written, and a spare buffer to
+  // serialize the next one into, so steady state saves don't allocate.
+  std::vector<char> pending_;
+  std::vector<char> spare_;
+  bool has_pending_ = false;
+  bool writing_ = false;
+  bool stopping_ = false;
+  std::exception_ptr error_;
+  std::thread writer_;
+};
+
+}  // namespace micrograd
@@ -0,0 +1,75 @@
+#include "micrograd/checkpoint.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace micrograd {
+
+namespace {
+
+std::filesystem::path TempPath(const std::string& name) {
+  return std::filesystem::path(testing::TempDir()) / name;
+}
+
+std::vector<float> Values(const MLP& model) {
+  std::span<const float> values = model.ParameterValues();
+  return std::vector(values.begin(), values.end());
+}
+
+}  // namespace
+
+TEST(MicrogradCheckpoint, RoundTrip) {
+  std::filesystem::path path = TempPath("round_trip.mlp");
+  auto model = MLP(3, std::vector<size_t>{4, 4, 2});
+  SaveCheckpoint(path, model);
+  MLP loaded = LoadCheckpoint(path);
+  EXPECT_EQ(loaded.number_of_inputs(), 3);
+  EXPECT_EQ(loaded.number_of_outputs(), (std::vector<size_t>{4, 4, 2}));
+  EXPECT_EQ(Values(loaded), Values(model));
+  std::vector<float> x = {0.5, -1, 2};
+  EXPECT_EQ(loaded.Evaluate(x), model.Evaluate(x));
+  EXPECT_FALSE(std::filesystem::exists(TempPath("round_trip.mlp.tmp")));
+}
+
+TEST(MicrogradCheckpoint, Invalid) {
+  EXPECT_THROW(LoadCheckpoint(TempPath("missing.mlp")), std::runtime_error);
+
+  std::filesystem::path path = TempPath("invalid.mlp");
+  std::ofstream(path) << "not a checkpoint, but long enough for a header";
+  EXPECT_THROW(LoadCheckpoint(path), std::runtime_error);
+
+  // Truncate a valid checkpoint by one value.
+  SaveCheckpoint(path, MLP(2, std::vector<size_t>{3, 1}));
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 4);
+  EXPECT_THROW(LoadCheckpoint(path), std::runtime_error);
+}
+
+TEST(MicrogradCheckpoint, Checkpointer) {
+  std::filesystem::path path = TempPath("checkpointer.mlp");
+  auto model = MLP(2, std::vector<size_t>{8, 1});
+  {
+    Checkpointer checkpointer(path);
+    for (int i = 0; i < 10; ++i) {
+      model.ParameterValues()[0] = i;
+      checkpointer.Save(model);
+    }
+    // Only the last checkpoint is guaranteed to be written.
+    checkpointer.Wait();
+    EXPECT_EQ(Values(LoadCheckpoint(path)), Values(model));
+
+    model.ParameterValues()[0] = 42;
+    checkpointer.Save(model);
+  }
+  // The destructor writes the pending checkpoint.
+  EXPECT_EQ(LoadCheckpoint(path).ParameterValues()[0], 42);
+
+  Checkpointer failing(TempPath("missing_directory") / "checkpoint.mlp");
+  failing.Save(model);
+  EXPECT_THROW(failing.Wait(), std::runtime_error);
+}
+
+}  // namespace micrograd
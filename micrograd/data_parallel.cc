@@ -0,0 +1,52 @@
+#include "micrograd/data_parallel.h"
+
+#include <stdexcept>
+
+namespace micrograd {
+
+DataParallel::DataParallel(std::span<const Value> parameters,
+                           size_t threads)
+    : pool_(threads),
+      parameters_(parameters.begin(), parameters.end()),
+      gradients_(pool_.size()),
+      losses_(pool_.size()) {
+  for (const Value& p : parameters_) {
+    if (p.tape_ != nullptr) {
+      throw std::invalid_argument("parameters must not be on a tape");
+    }
+  }
+  for (size_t i = 0; i < pool_.size(); ++i) {
+    tapes_.push_back(std::make_unique<Tape>());
+    gradients_[i].resize(parameters_.size());
+  }
+}
+
+float DataParallel::Backward(size_t size, Shard shard) {
+  size_t shards = tapes_.size();
+  pool_.ParallelFor(shards, [&](size_t i) {
+    Tape& tape = *tapes_[i];
+    tape.Reset();
+    Tape::Scope scope(&tape);
+    Value loss = shard(size * i / shards, size * (i + 1) / shards);
+    uint32_t root = tape.Operand(loss);
+    tape.Propagate(root);
+    losses_[i] = tape.value(root);
+    for (size_t j = 0; j < parameters_.size(); ++j) {
+      gradients_[i][j] = tape.BoundGradient(parameters_[j]);
+    }
+  });
+  float total = 0.0;
+  for (size_t i = 0; i < shards; ++i) {
+    total += losses_[i];
+  }
+  for (size_t j = 0; j < parameters_.size(); ++j) {
+    float gradient = 0.0;
+    for (size_t i = 0; i < shards; ++i) {
+      gradient += gradients_[i][j];
+    }
+    parameters_[j].gradient(parameters_[j].gradient() + gradient);
+  }
+  return total;
+}
+
+}  // namespace micrograd
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "micrograd/micrograd.h"
+#include "micrograd/tape.h"
+#include "micrograd/thread_pool.h"
+
+namespace micrograd {
+
+/**
+ * Computes the gradients of a loss that is a sum over a dataset using several
+ * threads.
+ *
+ * The dataset is split into one contiguous shard per thread, and each thread
+ * records the loss of its shard on its own `Tape` against the shared
+ * parameters. The parameters are only read while the shards are running, the
+ * gradient of each shard is kept on its own tape and then the gradients are
+ * added to the parameters in shard order. This makes the result bitwise
+ * reproducible for a given number of threads.
+ */
+class DataParallel {
+ public:
+  // Builds the loss of the examples in [begin, end) of the dataset.
+  //
+  // This is called concurrently from several threads, with a `Tape::Scope`
+  // active for each of them, so it must not modify shared state other than
+  // its own part of any outputs.
+  using Shard = absl::FunctionRef<Value(size_t begin, size_t end)>;
+
+  // Train `parameters`, which must not be recorded on a tape, using
+  // `threads` threads.
+  DataParallel(std::span<const Value> parameters, size_t threads);
+
+  /**
+   * Back propagate the loss of every shard of a dataset of `size` examples,
+   * accumulating the gradients into the parameters.
+   *
+   * Returns the sum of the losses of the shards.
+   */
+  float Backward(size_t size, Shard shard);
+
+ private:
+  ThreadPool pool_;
+  std::vector<Value> parameters_;
+  std::vector<std::unique_ptr<Tape>> tapes_;
+  // The gradients of the parameters for each shard.
+  std::vector<std::vector<float>> gradients_;
+  std::vector<float> losses_;
+};
+
+}  // namespace micrograd
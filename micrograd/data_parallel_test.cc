@@ -0,0 +1,73 @@
+#include "micrograd/data_parallel.h"
+
+#include <gtest/gtest.h>
+
+#include "micrograd/nn.h"
+
+namespace micrograd {
+
+namespace {
+
+// Train for a few steps on `threads` threads, returning the losses and the
+// final parameters.
+std::vector<float> Train(size_t threads) {
+  auto model = MLP(2, std::vector<size_t>{8, 1});
+  std::span<const Value> parameters = model.Parameters();
+  // Make every run start from the same parameters.
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    parameters[i].value(0.1 * (i % 7) - 0.3);
+  }
+  auto parallel = DataParallel(parameters, threads);
+  std::vector<float> results;
+  for (size_t step = 0; step < 5; ++step) {
+    for (const Value& p : parameters) {
+      p.gradient(0);
+    }
+    results.push_back(parallel.Backward(101, [&](size_t begin, size_t end) {
+      std::vector<Value> losses;
+      for (size_t i = begin; i < end; ++i) {
+        std::vector<Value> x = {Value(0.01 * i), Value(1 - 0.02 * i)};
+        Value target = Value(i % 2 == 0 ? 1 : -1);
+        losses.push_back(model(x).front().Subtract(target).Pow(2));
+      }
+      return Sum(losses);
+    }));
+    for (const Value& p : parameters) {
+      p.value(p.value() - 0.001 * p.gradient());
+    }
+  }
+  for (const Value& p : parameters) {
+    results.push_back(p.value());
+  }
+  return results;
+}
+
+}  // namespace
+
+TEST(MicrogradDataParallel, MatchesSingleThread) {
+  std::vector<float> expected = Train(1);
+  for (size_t threads : {2, 3, 8}) {
+    std::vector<float> actual = Train(threads);
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+      EXPECT_NEAR(actual[i], expected[i], 1e-4);
+    }
+  }
+}
+
+TEST(MicrogradDataParallel, Reproducible) {
+  std::vector<float> expected = Train(4);
+  for (size_t run = 0; run < 3; ++run) {
+    // Bitwise identical.
+    EXPECT_EQ(Train(4), expected);
+  }
+}
+
+TEST(MicrogradDataParallel, ParametersOnTape) {
+  Tape tape;
+  Tape::Scope scope(&tape);
+  std::vector<Value> parameters = {Value(1)};
+  EXPECT_THROW(DataParallel(parameters, 2), std::invalid_argument);
+}
+
+}  // namespace micrograd
@@ -0,0 +1,141 @@
+#include "micrograd/dataset.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+namespace micrograd {
+
+namespace {
+
+constexpr char kMagic[8] = {'M', 'G', 'D', 'A', 'T', 'A', '\0', '\0'};
+constexpr uint32_t kVersion = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t dimensions;
+  uint64_t size;
+};
+static_assert(sizeof(Header) == 24 && sizeof(Header) % alignof(float) == 0);
+
+std::runtime_error Error(const std::filesystem::path& path,
+                         const std::string& message) {
+  return std::runtime_error(path.string() + ": " + message);
+}
+
+}  // namespace
+
+void MappedDataset::Write(const std::filesystem::path& path,
+                          size_t dimensions, std::span<const float> features,
+                          std::span<const float> labels) {
+  if (features.size() != dimensions * labels.size()) {
+    throw std::invalid_argument("features and labels have different sizes");
+  }
+  if (dimensions > std::numeric_limits<uint32_t>::max()) {
+    throw std::invalid_argument("too many features per example");
+  }
+  Header header = {.version = kVersion,
+                   .dimensions = static_cast<uint32_t>(dimensions),
+                   .size = labels.size()};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(features.data()),
+            features.size_bytes());
+  out.write(reinterpret_cast<const char*>(labels.data()), labels.size_bytes());
+  out.close();
+  if (!out) {
+    throw Error(path, "failed to write dataset");
+  }
+}
+
+MappedDataset::MappedDataset(const std::filesystem::path& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw Error(path, std::strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    throw Error(path, std::strerror(error));
+  }
+  length_ = st.st_size;
+  if (length_ < sizeof(Header)) {
+    close(fd);
+    throw Error(path, "not a dataset");
+  }
+  data_ = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+  int error = errno;
+  // The mapping keeps the file alive on its own.
+  close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw Error(path, std::strerror(error));
+  }
+  const auto* header = static_cast<const Header*>(data_);
+  const auto* floats = reinterpret_cast<const float*>(header + 1);
+  size_t bytes = length_ - sizeof(Header);
+  size_t available = bytes / sizeof(float);
+  // The features and label of one example.
+  uint64_t row = uint64_t{header->dimensions} + 1;
+  std::string problem;
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+    problem = "not a dataset";
+  } else if (header->version != kVersion) {
+    problem = "unsupported version " + std::to_string(header->version);
+  } else if (bytes % sizeof(float) != 0 || available % row != 0 ||
+             available / row != header->size) {
+    problem = "size does not match the header";
+  }
+  if (!problem.empty()) {
+    munmap(data_, length_);
+    data_ = nullptr;
+    throw Error(path, problem);
+  }
+  dimensions_ = header->dimensions;
+  features_ = std::span(floats, dimensions_ * header->size);
+  labels_ = std::span(floats + features_.size(), header->size);
+}
+
+MappedDataset::~MappedDataset() {
+  if (data_ != nullptr) {
+    munmap(data_, length_);
+  }
+}
+
+MiniBatches::MiniBatches(size_t size, size_t batch_size, uint64_t seed)
+    : order_(size), batch_size_(batch_size), position_(0), rng_(seed) {
+  if (batch_size == 0 || batch_size > size) {
+    throw std::invalid_argument("batch size must be in [1, dataset size]");
+  }
+  if (size > std::numeric_limits<uint32_t>::max()) {
+    throw std::invalid_argument("dataset is too large");
+  }
+  std::iota(order_.begin(), order_.end(), 0);
+  std::shuffle(order_.begin(), order_.end(), rng_);
+}
+
+std::span<const uint32_t> MiniBatches::Next() {
+  if (position_ + batch_size_ > order_.size()) {
+    std::shuffle(order_.begin(), order_.end(), rng_);
+    position_ = 0;
+    ++epoch_;
+  }
+  auto batch = std::span(order_).subspan(position_, batch_size_);
+  position_ += batch_size_;
+  return batch;
+}
+
+}  // namespace micrograd
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <span>
+#include <vector>
+
+namespace micrograd {
+
+/**
+ * A labelled dataset stored in a compact binary file, which is memory mapped
+ * instead of being parsed.
+ *
+ * The file is a small header (a magic number, a version, the number of
+ * features per example and the number of examples) followed by the features
+ * of every example as row-major floats, and then the label of every example.
+ * Opening a file only maps it, so examples are paged in as they are first
+ * touched and never copied.
+ *
+ * The file is read in the native byte order, and must not be modified while
+ * it is open.
+ */
+class MappedDataset {
+ public:
+  // Write `features`, which has `dimensions` floats per example, and one
+  // label per example to `path`.
+  static void Write(const std::filesystem::path& path, size_t dimensions,
+                    std::span<const float> features,
+                    std::span<const float> labels);
+
+  // Map the dataset at `path`, throwing if it is not a valid dataset.
+  explicit MappedDataset(const std::filesystem::path& path);
+  MappedDataset(const MappedDataset&) = delete;
+  MappedDataset& operator=(const MappedDataset&) = delete;
+  ~MappedDataset();
+
+  // The number of examples.
+  size_t size() const { return labels_.size(); }
+  // The number of features per example.
+  size_t dimensions() const { return dimensions_; }
+
+  // The features of all the examples, in row-major order.
+  std::span<const float> features() const { return features_; }
+  std::span<const float> features(size_t i) const {
+    return features_.subspan(i * dimensions_, dimensions_);
+  }
+  std::span<const float> labels() const { return labels_; }
+
+ private:
+  void* data_ = nullptr;
+  size_t length_ = 0;
+  size_t dimensions_ = 0;
+  std::span<const float> features_;
+  std::span<const float> labels_;
+};
+
+/**
+ * Splits a dataset into random mini-batches.
+ *
+ * Each epoch is a fresh shuffle of the examples, cut into batches of exactly
+ * `batch_size` examples. The examples left over at the end of an epoch are
+ * dropped, so every batch has the same shape (and can be replayed by a
+ * `Program`), and since the next epoch reshuffles, no example is dropped
+ * every time. The order only depends on the seed.
+ */
+class MiniBatches {
+ public:
+  // Batches over a dataset of `size` examples, which must be at least
+  // `batch_size`.
+  MiniBatches(size_t size, size_t batch_size, uint64_t seed);
+
+  // The indices of the examples in the next batch, which stay valid until
+  // the next call.
+  std::span<const uint32_t> Next();
+
+  // The number of complete epochs so far.
+  size_t epoch() const { return epoch_; }
+
+ private:
+  std::vector<uint32_t> order_;
+  size_t batch_size_;
+  size_t position_;
+  size_t epoch_ = 0;
+  std::mt19937_64 rng_;
+};
+
+}  // namespace micrograd
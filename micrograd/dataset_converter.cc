@@ -0,0 +1,56 @@
+// Converts a JSON dataset in the format of `demo_input.json` into the binary
+// format of `micrograd::MappedDataset`.
+//
+//   bazel run //micrograd:dataset_converter -- --input=$PWD/micrograd/demo_input.json --output=/tmp/moons.bin
+
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "micrograd/dataset.h"
+
+ABSL_FLAG(std::string, input, "",
+          "a JSON object with the examples as a 'data' array of arrays of "
+          "features, and their labels as a 'classifications' array");
+ABSL_FLAG(std::string, output, "", "where to write the binary dataset");
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  std::string input = absl::GetFlag(FLAGS_input);
+  std::string output = absl::GetFlag(FLAGS_output);
+  if (input.empty() || output.empty()) {
+    throw std::runtime_error("--input and --output are required");
+  }
+  std::ifstream f{input};
+  nlohmann::json root = nlohmann::json::parse(f,
+                                              /*cb=*/nullptr,
+                                              /*allow_exceptions=*/true,
+                                              /*ignore_comments=*/true);
+  if (!root["data"].is_array() || !root["classifications"].is_array()) {
+    throw std::runtime_error("invalid dataset");
+  }
+  size_t dimensions = root["data"].empty() ? 0 : root["data"][0].size();
+  std::vector<float> features;
+  features.reserve(dimensions * root["data"].size());
+  for (const auto& example : root["data"]) {
+    if (!example.is_array() || example.size() != dimensions) {
+      throw std::runtime_error("invalid example");
+    }
+    for (const auto& feature : example) {
+      features.push_back(feature.get<float>());
+    }
+  }
+  std::vector<float> labels;
+  labels.reserve(root["classifications"].size());
+  for (const auto& label : root["classifications"]) {
+    labels.push_back(label.get<float>());
+  }
+  micrograd::MappedDataset::Write(output, dimensions, features, labels);
+  std::cout << "wrote " << labels.size() << " examples with " << dimensions
+            << " features to " << output << "\n";
+}
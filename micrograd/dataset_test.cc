@@ -0,0 +1,75 @@
+#include "micrograd/dataset.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace micrograd {
+
+namespace {
+
+std::filesystem::path TempPath(const std::string& name) {
+  return std::filesystem::path(testing::TempDir()) / name;
+}
+
+}  // namespace
+
+TEST(MicrogradDataset, RoundTrip) {
+  std::filesystem::path path = TempPath("round_trip.bin");
+  std::vector<float> features = {1, 2, 3, 4, 5, 6};
+  std::vector<float> labels = {-1, 1};
+  MappedDataset::Write(path, 3, features, labels);
+  MappedDataset dataset(path);
+  EXPECT_EQ(dataset.size(), 2);
+  EXPECT_EQ(dataset.dimensions(), 3);
+  EXPECT_EQ(std::vector(dataset.features().begin(), dataset.features().end()),
+            features);
+  EXPECT_EQ(std::vector(dataset.labels().begin(), dataset.labels().end()),
+            labels);
+  EXPECT_EQ(dataset.features(1)[0], 4);
+}
+
+TEST(MicrogradDataset, Invalid) {
+  EXPECT_THROW(MappedDataset(TempPath("missing.bin")), std::runtime_error);
+  EXPECT_THROW(MappedDataset::Write(TempPath("bad.bin"), 2, {{1, 2, 3}}, {{1}}),
+               std::invalid_argument);
+
+  std::filesystem::path path = TempPath("not_a_dataset.bin");
+  std::ofstream(path) << "{\"data\": [], \"classifications\": []}";
+  EXPECT_THROW(MappedDataset{path}, std::runtime_error);
+
+  path = TempPath("truncated.bin");
+  MappedDataset::Write(path, 2, {{1, 2, 3, 4}}, {{1, -1}});
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 4);
+  EXPECT_THROW(MappedDataset{path}, std::runtime_error);
+}
+
+TEST(MicrogradDataset, MiniBatches) {
+  constexpr size_t kSize = 10;
+  MiniBatches batches(kSize, 3, /*seed=*/7);
+  MiniBatches same(kSize, 3, /*seed=*/7);
+  // Each epoch is three batches, and the last example is dropped.
+  for (size_t epoch = 0; epoch < 3; ++epoch) {
+    std::vector<int> seen(kSize);
+    for (size_t i = 0; i < 3; ++i) {
+      std::span<const uint32_t> batch = batches.Next();
+      ASSERT_EQ(batch.size(), 3);
+      EXPECT_EQ(batches.epoch(), epoch);
+      std::span<const uint32_t> expected = same.Next();
+      EXPECT_TRUE(std::equal(batch.begin(), batch.end(), expected.begin()));
+      for (uint32_t j : batch) {
+        ASSERT_LT(j, kSize);
+        ++seen[j];
+      }
+    }
+    EXPECT_EQ(std::count(seen.begin(), seen.end(), 1), 9);
+  }
+  EXPECT_THROW(MiniBatches(2, 3, 0), std::invalid_argument);
+  EXPECT_THROW(MiniBatches(2, 0, 0), std::invalid_argument);
+}
+
+}  // namespace micrograd
@@ -0,0 +1,129 @@
+#include "micrograd/graph_export.h"
+
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+
+#include "absl/strings/str_format.h"
+#include "micrograd/tape.h"
+#include "micrograd/value_impl.h"
+
+namespace micrograd {
+
+namespace {
+
+const char* OpName(Op op) {
+  switch (op) {
+    case Op::kNone:
+      return "leaf";
+    case Op::kAdd:
+      return "add";
+    case Op::kSubtract:
+      return "subtract";
+    case Op::kMultiply:
+      return "multiply";
+    case Op::kDivide:
+      return "divide";
+    case Op::kNegate:
+      return "negate";
+    case Op::kAddConstant:
+      return "add_constant";
+    case Op::kMultiplyConstant:
+      return "multiply_constant";
+    case Op::kPow:
+      return "pow";
+    case Op::kReLU:
+      return "relu";
+    case Op::kDot:
+      return "dot";
+    case Op::kSum:
+      return "sum";
+    case Op::kHinge:
+      return "hinge_loss";
+    case Op::kMeanSquaredError:
+      return "mean_squared_error";
+    case Op::kSoftmaxCrossEntropy:
+      return "softmax_cross_entropy";
+  }
+  return "unknown";
+}
+
+// Writes `v` with enough digits to read it back exactly, or `null`, since
+// JSON has no infinities or NaNs.
+template <Scalar T>
+void WriteNumber(std::ostream& out, T v) {
+  constexpr int kDigits = std::is_same_v<T, double> ? 17 : 9;
+  double d = static_cast<double>(v);
+  if (std::isfinite(d)) {
+    out << absl::StreamFormat("%.*g", kDigits, d);
+  } else {
+    out << "null";
+  }
+}
+
+}  // namespace
+
+template <Scalar T>
+class GraphWriter {
+ public:
+  // Visits the nodes of the graph of `root`, wherever it lives, like
+  // `ValueImpl::ForEachNode`.
+  template <typename Fn>
+  static void ForEachNode(const BasicValue<T>& root, Fn fn) {
+    if constexpr (BasicValue<T>::kTaped) {
+      if (root.tape_ != nullptr) {
+        root.tape_->ForEachNode(root.index_, fn);
+        return;
+      }
+    }
+    root.impl_->ForEachNode(fn);
+  }
+};
+
+template <Scalar T>
+void WriteDot(const BasicValue<T>& root, std::ostream& out) {
+  out << "digraph {\n";
+  GraphWriter<T>::ForEachNode(
+      root, [&](uint64_t id, Op op, T value, T grad,
+                std::span<const uint64_t> children) {
+        out << absl::StreamFormat(
+            "  n%d [label=\"%s\\nvalue %.4g\\ngrad %.4g\"];\n", id,
+            OpName(op), static_cast<double>(value), static_cast<double>(grad));
+        for (uint64_t child : children) {
+          out << absl::StreamFormat("  n%d -> n%d;\n", child, id);
+        }
+      });
+  out << "}\n";
+}
+
+template <Scalar T>
+void WriteJson(const BasicValue<T>& root, std::ostream& out) {
+  uint64_t root_id = 0;
+  out << "{\"nodes\":[";
+  GraphWriter<T>::ForEachNode(
+      root, [&](uint64_t id, Op op, T value, T grad,
+                std::span<const uint64_t> children) {
+        out << absl::StreamFormat("%s\n{\"id\":%d,\"op\":\"%s\",\"value\":",
+                                  id == 0 ? "" : ",", id, OpName(op));
+        WriteNumber(out, value);
+        out << ",\"grad\":";
+        WriteNumber(out, grad);
+        out << ",\"children\":[";
+        for (size_t i = 0; i < children.size(); ++i) {
+          out << absl::StreamFormat("%s%d", i == 0 ? "" : ",", children[i]);
+        }
+        out << "]}";
+        root_id = id;
+      });
+  out << absl::StreamFormat("\n],\"root\":%d}\n", root_id);
+}
+
+template void WriteDot(const BasicValue<float>&, std::ostream&);
+template void WriteDot(const BasicValue<double>&, std::ostream&);
+template void WriteDot(const BasicValue<BFloat16>&, std::ostream&);
+template void WriteJson(const BasicValue<float>&, std::ostream&);
+template void WriteJson(const BasicValue<double>&, std::ostream&);
+template void WriteJson(const BasicValue<BFloat16>&, std::ostream&);
+
+}  // namespace micrograd
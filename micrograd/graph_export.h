@@ -0,0 +1,44 @@
+#pragma once
+
+#include <ostream>
+
+#include "micrograd/micrograd.h"
+#include "micrograd/scalar.h"
+
+namespace micrograd {
+
+/**
+ * Write the graph that `root` was computed from to `out`, as a Graphviz
+ * `digraph` with an edge from each operand to the node that uses it.
+ *
+ * Every node is written once, however many paths lead to it, and the output
+ * is streamed as the graph is visited instead of being built in memory, so
+ * this takes time and memory linear in the number of nodes even for graphs
+ * with millions of them. The nodes are numbered from 0, operands before the
+ * nodes that use them, so `root` has the last id.
+ */
+template <Scalar T>
+void WriteDot(const BasicValue<T>& root, std::ostream& out);
+
+/**
+ * Write the same graph as `WriteDot` as JSON, one node per line:
+ *
+ *   {"nodes":[
+ *   {"id":0,"op":"leaf","value":2,"grad":1,"children":[]},
+ *   ...
+ *   ],"root":3}
+ *
+ * with the nodes in the same order and with the same ids. Values that are not
+ * finite are written as `null`.
+ */
+template <Scalar T>
+void WriteJson(const BasicValue<T>& root, std::ostream& out);
+
+extern template void WriteDot(const BasicValue<float>&, std::ostream&);
+extern template void WriteDot(const BasicValue<double>&, std::ostream&);
+extern template void WriteDot(const BasicValue<BFloat16>&, std::ostream&);
+extern template void WriteJson(const BasicValue<float>&, std::ostream&);
+extern template void WriteJson(const BasicValue<double>&, std::ostream&);
+extern template void WriteJson(const BasicValue<BFloat16>&, std::ostream&);
+
+}  // namespace micrograd
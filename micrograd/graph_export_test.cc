@@ -0,0 +1,134 @@
+#include "micrograd/graph_export.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <sstream>
+#include <streambuf>
+#include <string>
+
+#include "micrograd/tape.h"
+
+namespace micrograd {
+
+namespace {
+
+// Counts the lines written to it, without keeping them.
+class LineCounter : public std::streambuf {
+ public:
+  size_t lines() const { return lines_; }
+
+ protected:
+  int overflow(int c) override {
+    lines_ += c == '\n';
+    return c;
+  }
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    lines_ += std::count(s, s + n, '\n');
+    return n;
+  }
+
+ private:
+  size_t lines_ = 0;
+};
+
+size_t Count(const std::string& s, const std::string& pattern) {
+  size_t count = 0;
+  for (size_t i = s.find(pattern); i != std::string::npos;
+       i = s.find(pattern, i + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+}  // namespace
+
+TEST(MicrogradGraphExport, Tape) {
+  Tape tape;
+  Tape::Scope scope(&tape);
+  auto a = Value(2);
+  auto b = Value(-3);
+  // Not part of the graph of `c`.
+  b.Relu();
+  Value c = a.Multiply(b).Add(a);
+  c.Backward();
+
+  std::ostringstream dot;
+  WriteDot(c, dot);
+  EXPECT_EQ(dot.str(),
+            "digraph {\n"
+            "  n0 [label=\"leaf\\nvalue 2\\ngrad -2\"];\n"
+            "  n1 [label=\"leaf\\nvalue -3\\ngrad 2\"];\n"
+            "  n2 [label=\"multiply\\nvalue -6\\ngrad 1\"];\n"
+            "  n0 -> n2;\n"
+            "  n1 -> n2;\n"
+            "  n3 [label=\"add\\nvalue -4\\ngrad 1\"];\n"
+            "  n2 -> n3;\n"
+            "  n0 -> n3;\n"
+            "}\n");
+
+  std::ostringstream json;
+  WriteJson(c, json);
+  EXPECT_EQ(json.str(),
+            "{\"nodes\":[\n"
+            "{\"id\":0,\"op\":\"leaf\",\"value\":2,\"grad\":-2,"
+            "\"children\":[]},\n"
+            "{\"id\":1,\"op\":\"leaf\",\"value\":-3,\"grad\":2,"
+            "\"children\":[]},\n"
+            "{\"id\":2,\"op\":\"multiply\",\"value\":-6,\"grad\":1,"
+            "\"children\":[0,1]},\n"
+            "{\"id\":3,\"op\":\"add\",\"value\":-4,\"grad\":1,"
+            "\"children\":[2,0]}\n"
+            "],\"root\":3}\n");
+}
+
+TEST(MicrogradGraphExport, SharedSubgraphs) {
+  // There are 2^64 paths from the root to the leaf, but each node is only
+  // written once.
+  auto heap = BasicValue<double>(1);
+  for (int i = 0; i < 64; ++i) {
+    heap = heap.Add(heap);
+  }
+  std::ostringstream dot;
+  WriteDot(heap, dot);
+  EXPECT_EQ(Count(dot.str(), "[label="), 65);
+  EXPECT_EQ(Count(dot.str(), " -> "), 64);
+
+  Tape tape;
+  Tape::Scope scope(&tape);
+  auto taped = Value(1);
+  for (int i = 0; i < 64; ++i) {
+    taped = taped.Multiply(taped);
+  }
+  std::ostringstream json;
+  WriteJson(taped, json);
+  EXPECT_EQ(Count(json.str(), "\"id\""), 65);
+  EXPECT_NE(json.str().find("\"children\":[63]}\n],\"root\":64}"),
+            std::string::npos);
+}
+
+TEST(MicrogradGraphExport, Large) {
+  constexpr int kNodes = 1 << 20;
+  auto heap = Value(0);
+  for (int i = 1; i < kNodes; ++i) {
+    heap = heap.Add(1);
+  }
+  LineCounter heap_lines;
+  std::ostream heap_out(&heap_lines);
+  WriteJson(heap, heap_out);
+  EXPECT_EQ(heap_lines.lines(), kNodes + 2);
+
+  Tape tape;
+  Tape::Scope scope(&tape);
+  auto taped = Value(0);
+  for (int i = 1; i < kNodes; ++i) {
+    taped = taped.Add(1);
+  }
+  LineCounter taped_lines;
+  std::ostream taped_out(&taped_lines);
+  WriteDot(taped, taped_out);
+  // A line for each node and each edge, and the braces.
+  EXPECT_EQ(taped_lines.lines(), 2 * kNodes - 1 + 2);
+}
+
+}  // namespace micrograd
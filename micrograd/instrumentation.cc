@@ -0,0 +1,188 @@
+#include "micrograd/instrumentation.h"
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+
+namespace micrograd::instrumentation {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Event {
+  const char* name;
+  uint32_t thread;
+  Clock::time_point start;
+  Clock::duration duration;
+  uint64_t live_bytes;
+};
+
+struct Totals {
+  uint64_t count = 0;
+  Clock::duration duration{};
+};
+
+struct State {
+  std::array<std::atomic<uint64_t>, 256> op_counts{};
+  std::atomic<uint64_t> live_nodes = 0;
+  std::atomic<uint64_t> live_bytes = 0;
+  std::atomic<uint64_t> peak_bytes = 0;
+
+  std::mutex mu;
+  Clock::time_point epoch = Clock::now();
+  std::vector<Event> events;
+  // The events that didn't fit in `events`.
+  uint64_t dropped_events = 0;
+  // Keyed by the name itself rather than its address, since the same name
+  // can be spelled by different literals.
+  std::map<std::string_view, Totals> totals;
+};
+
+State& state() {
+  static State* state = new State();
+  return *state;
+}
+
+// A small, stable id for the current thread, so the trace has one track per
+// thread in the order they first recorded something.
+uint32_t ThreadId() {
+  static std::atomic<uint32_t> next = 0;
+  thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+int64_t Microseconds(Clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+}  // namespace
+
+void CountOp(char op) {
+  state().op_counts[static_cast<unsigned char>(op)].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+void NodeCreated(size_t bytes) {
+  State& s = state();
+  s.live_nodes.fetch_add(1, std::memory_order_relaxed);
+  uint64_t live =
+      s.live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  uint64_t peak = s.peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !s.peak_bytes.compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+void NodeDestroyed(size_t bytes) {
+  State& s = state();
+  s.live_nodes.fetch_sub(1, std::memory_order_relaxed);
+  s.live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void NodeShrunk(size_t bytes) {
+  state().live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+uint64_t op_count(char op) {
+  return state().op_counts[static_cast<unsigned char>(op)].load();
+}
+uint64_t live_nodes() { return state().live_nodes.load(); }
+uint64_t live_bytes() { return state().live_bytes.load(); }
+uint64_t peak_bytes() { return state().peak_bytes.load(); }
+
+ScopedTimer::ScopedTimer(const char* name)
+    : name_(name), start_(Clock::now()) {}
+
+ScopedTimer::~ScopedTimer() {
+  Clock::duration duration = Clock::now() - start_;
+  uint32_t thread = ThreadId();
+  State& s = state();
+  std::lock_guard lock(s.mu);
+  if (s.events.size() < kMaxTraceEvents) {
+    s.events.push_back({
+        .name = name_,
+        .thread = thread,
+        .start = start_,
+        .duration = duration,
+        .live_bytes = s.live_bytes.load(std::memory_order_relaxed),
+    });
+  } else {
+    ++s.dropped_events;
+  }
+  Totals& totals = s.totals[name_];
+  ++totals.count;
+  totals.duration += duration;
+}
+
+void WriteChromeTrace(std::ostream& out) {
+  State& s = state();
+  std::lock_guard lock(s.mu);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  for (const Event& e : s.events) {
+    int64_t start = Microseconds(e.start - s.epoch);
+    int64_t end = start + Microseconds(e.duration);
+    // Names are identifiers chosen by the engine, so they need no escaping.
+    out << (first ? "\n" : ",\n")
+        << absl::StrFormat(
+               R"({"name":"%s","ph":"X","pid":1,"tid":%d,"ts":%d,"dur":%d})",
+               e.name, e.thread, start, end - start)
+        << absl::StrFormat(
+               R"(,{"name":"nodes","ph":"C","pid":1,"ts":%d,)"
+               R"("args":{"live_bytes":%d}})",
+               end, e.live_bytes);
+    first = false;
+  }
+  out << "\n]}\n";
+}
+
+std::string Summary() {
+  State& s = state();
+  std::string summary = absl::StrFormat("%-24s %12s\n", "op", "count");
+  for (size_t op = 0; op < s.op_counts.size(); ++op) {
+    if (uint64_t count = s.op_counts[op].load()) {
+      summary += absl::StrFormat("'%c'%21s %12d\n", static_cast<char>(op), "",
+                                 count);
+    }
+  }
+  summary += absl::StrFormat("%-24s %12d\n", "live nodes", live_nodes());
+  summary += absl::StrFormat("%-24s %12d\n", "live node bytes", live_bytes());
+  summary += absl::StrFormat("%-24s %12d\n", "peak node bytes", peak_bytes());
+  summary += absl::StrFormat("\n%-24s %12s %12s %12s\n", "timer", "count",
+                             "total ms", "mean us");
+  std::lock_guard lock(s.mu);
+  for (const auto& [name, totals] : s.totals) {
+    double total = std::chrono::duration<double, std::milli>(totals.duration)
+                       .count();
+    summary += absl::StrFormat("%-24s %12d %12.3f %12.3f\n", name,
+                               totals.count, total,
+                               1000 * total / totals.count);
+  }
+  if (s.dropped_events > 0) {
+    summary += absl::StrFormat("\n%-24s %12d\n", "dropped trace events",
+                               s.dropped_events);
+  }
+  return summary;
+}
+
+void Reset() {
+  State& s = state();
+  for (auto& count : s.op_counts) {
+    count.store(0);
+  }
+  // Live nodes are still alive, so only the peak starts over.
+  s.peak_bytes.store(s.live_bytes.load());
+  std::lock_guard lock(s.mu);
+  s.epoch = Clock::now();
+  s.events.clear();
+  s.dropped_events = 0;
+  s.totals.clear();
+}
+
+}  // namespace micrograd::instrumentation
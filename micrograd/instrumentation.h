@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Opt-in counters and timers for seeing where the time and memory of a
+ * training step goes.
+ *
+ * The engine reports to this module through the `MICROGRAD_*` macros below,
+ * which expand to nothing unless the whole build defines
+ * `MICROGRAD_INSTRUMENTATION` (`bazel build --config=instrument`), so the
+ * instrumentation costs nothing when it is compiled out. The functions
+ * themselves are always available, so tools can dump whatever was recorded
+ * without their own `#ifdef`s.
+ */
+namespace micrograd::instrumentation {
+
+// Whether the engine was built with instrumentation.
+#ifdef MICROGRAD_INSTRUMENTATION
+inline constexpr bool kEnabled = true;
+#else
+inline constexpr bool kEnabled = false;
+#endif
+
+// Count an operation (or a leaf, for the op ' ') recorded on either engine,
+// keyed by the symbol of its `Op`.
+void CountOp(char op);
+
+// Track the heap nodes that are alive, and how many bytes they hold.
+void NodeCreated(size_t bytes);
+void NodeDestroyed(size_t bytes);
+// A live node released `bytes` of what it held.
+void NodeShrunk(size_t bytes);
+
+// The number of operations recorded with the symbol `op`.
+uint64_t op_count(char op);
+uint64_t live_nodes();
+uint64_t live_bytes();
+// The most bytes held by live nodes at any point.
+uint64_t peak_bytes();
+
+// The most events the trace keeps. Timers that are very frequent (such as
+// one per sample) would otherwise grow the trace without bound and distort
+// the memory it is meant to measure, so once it is full only the totals are
+// updated, and `Summary` reports how many events were dropped.
+inline constexpr size_t kMaxTraceEvents = 1 << 18;
+
+// Records the wall time of a scope as a complete event in the trace (up to
+// `kMaxTraceEvents`), and adds it to the totals for its name. `name` must
+// outlive the recording (typically it is a string literal).
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(const char* name);
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+  ~ScopedTimer();
+
+ private:
+  const char* name_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Write everything recorded so far as a Chrome `trace_event` JSON file, which
+// can be loaded in chrome://tracing or https://ui.perfetto.dev. Each timer is
+// a complete event on the thread that ran it, and the memory of the live
+// nodes is a counter sampled at the end of each timer.
+void WriteChromeTrace(std::ostream& out);
+
+// A table of the op counts, the node memory gauges and the totals of each
+// timer.
+std::string Summary();
+
+// Drop all the recorded events, counts and totals.
+void Reset();
+
+}  // namespace micrograd::instrumentation
+
+#ifdef MICROGRAD_INSTRUMENTATION
+#define MICROGRAD_COUNT_OP(op) \
+  ::micrograd::instrumentation::CountOp(static_cast<char>(op))
+#define MICROGRAD_NODE_CREATED(bytes) \
+  ::micrograd::instrumentation::NodeCreated(bytes)
+#define MICROGRAD_NODE_DESTROYED(bytes) \
+  ::micrograd::instrumentation::NodeDestroyed(bytes)
+#define MICROGRAD_NODE_SHRUNK(bytes) \
+  ::micrograd::instrumentation::NodeShrunk(bytes)
+#define MICROGRAD_TRACE_SCOPE(name) \
+  ::micrograd::instrumentation::ScopedTimer micrograd_trace_scope(name)
+#else
+#define MICROGRAD_COUNT_OP(op) \
+  do {                         \
+  } while (false)
+#define MICROGRAD_NODE_CREATED(bytes) \
+  do {                                \
+  } while (false)
+#define MICROGRAD_NODE_DESTROYED(bytes) \
+  do {                                  \
+  } while (false)
+#define MICROGRAD_NODE_SHRUNK(bytes) \
+  do {                               \
+  } while (false)
+#define MICROGRAD_TRACE_SCOPE(name) \
+  do {                              \
+  } while (false)
+#endif
@@ -0,0 +1,102 @@
+#include "micrograd/instrumentation.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <thread>
+
+#include "micrograd/micrograd.h"
+
+namespace micrograd {
+
+namespace {
+
+// The number of times `needle` occurs in `haystack`.
+size_t Count(const std::string& haystack, const std::string& needle) {
+  size_t count = 0;
+  for (size_t i = haystack.find(needle); i != std::string::npos;
+       i = haystack.find(needle, i + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+}  // namespace
+
+TEST(MicrogradInstrumentation, Timers) {
+  instrumentation::Reset();
+  {
+    instrumentation::ScopedTimer outer("Outer");
+    instrumentation::ScopedTimer inner("Inner");
+  }
+  std::thread([] { instrumentation::ScopedTimer other("Inner"); }).join();
+  std::ostringstream trace;
+  instrumentation::WriteChromeTrace(trace);
+  EXPECT_EQ(Count(trace.str(), R"("ph":"X")"), 3);
+  EXPECT_EQ(Count(trace.str(), R"("name":"Inner")"), 2);
+  EXPECT_EQ(Count(trace.str(), R"("name":"Outer")"), 1);
+  std::string summary = instrumentation::Summary();
+  EXPECT_NE(summary.find("Inner"), std::string::npos);
+  EXPECT_NE(summary.find("Outer"), std::string::npos);
+
+  instrumentation::Reset();
+  trace.str("");
+  instrumentation::WriteChromeTrace(trace);
+  EXPECT_EQ(Count(trace.str(), R"("ph":"X")"), 0);
+
+  // The trace stops growing once it is full, but the totals don't.
+  for (size_t i = 0; i < instrumentation::kMaxTraceEvents + 10; ++i) {
+    instrumentation::ScopedTimer timer("Frequent");
+  }
+  trace.str("");
+  instrumentation::WriteChromeTrace(trace);
+  EXPECT_EQ(Count(trace.str(), R"("ph":"X")"),
+            instrumentation::kMaxTraceEvents);
+  summary = instrumentation::Summary();
+  EXPECT_NE(summary.find(std::to_string(instrumentation::kMaxTraceEvents + 10)),
+            std::string::npos);
+  EXPECT_NE(summary.find("dropped trace events"), std::string::npos);
+  instrumentation::Reset();
+}
+
+TEST(MicrogradInstrumentation, Nodes) {
+  if (!instrumentation::kEnabled) {
+    GTEST_SKIP() << "built without MICROGRAD_INSTRUMENTATION";
+  }
+  instrumentation::Reset();
+  uint64_t live_nodes = instrumentation::live_nodes();
+  uint64_t live_bytes = instrumentation::live_bytes();
+  {
+    Value a = Value(2.0);
+    Value b = Value(3.0);
+    Value c = a.Multiply(b).Add(a).Relu();
+    c.Backward();
+    EXPECT_EQ(instrumentation::op_count(' '), 2);
+    EXPECT_EQ(instrumentation::op_count('*'), 1);
+    EXPECT_EQ(instrumentation::op_count('+'), 1);
+    EXPECT_EQ(instrumentation::op_count('?'), 1);
+    EXPECT_EQ(instrumentation::live_nodes(), live_nodes + 5);
+    EXPECT_GT(instrumentation::live_bytes(), live_bytes);
+  }
+  EXPECT_EQ(instrumentation::live_nodes(), live_nodes);
+  EXPECT_EQ(instrumentation::live_bytes(), live_bytes);
+  EXPECT_GT(instrumentation::peak_bytes(), live_bytes);
+  std::ostringstream trace;
+  instrumentation::WriteChromeTrace(trace);
+  EXPECT_EQ(Count(trace.str(), R"("name":"Backward")"), 1);
+  EXPECT_EQ(Count(trace.str(), R"("name":"TopologicalSort")"), 1);
+
+  // Releasing the graph during the backward pass shrinks the nodes that are
+  // still held, and they still balance the gauges when they are destroyed.
+  {
+    Value x = Value(2.0);
+    Value y = x.Add(x);
+    Value z = y.Multiply(x).Relu();
+    z.Backward(/*retain_graph=*/false);
+    EXPECT_EQ(instrumentation::live_nodes(), live_nodes + 3);
+  }
+  EXPECT_EQ(instrumentation::live_nodes(), live_nodes);
+  EXPECT_EQ(instrumentation::live_bytes(), live_bytes);
+}
+
+}  // namespace micrograd
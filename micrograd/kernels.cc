@@ -0,0 +1,258 @@
+#include "micrograd/kernels.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace micrograd::kernels {
+
+namespace {
+
+float DotScalar(const float* a, const float* b, size_t n) {
+  float sum = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+void AxpyScalar(float alpha, const float* x, float* y, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    y[i] += alpha * x[i];
+  }
+}
+
+float SumScalar(const float* a, size_t n) {
+  float sum = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += a[i];
+  }
+  return sum;
+}
+
+void MatVecScalar(const float* a, const float* x, float* y, size_t m,
+                  size_t n) {
+  for (size_t i = 0; i < m; ++i) {
+    AxpyScalar(x[i], a + i * n, y, n);
+  }
+}
+
+void TransposedMatmulScalar(const float* a, const float* b, float* c,
+                            size_t m, size_t n, size_t k) {
+  for (size_t i = 0; i < m; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      AxpyScalar(a[i * n + j], b + i * k, c + j * k, k);
+    }
+  }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2,fma"))) float HorizontalSum(__m256 v) {
+  __m128 sum =
+      _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma"))) float DotAvx2(const float* a,
+                                                  const float* b, size_t n) {
+  __m256 acc = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+  }
+  float sum = HorizontalSum(acc);
+  for (; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+__attribute__((target("avx2,fma"))) void AxpyAvx2(float alpha, const float* x,
+                                                  float* y, size_t n) {
+  __m256 a = _mm256_set1_ps(alpha);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 result =
+        _mm256_fmadd_ps(a, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i));
+    _mm256_storeu_ps(y + i, result);
+  }
+  for (; i < n; ++i) {
+    y[i] += alpha * x[i];
+  }
+}
+
+__attribute__((target("avx2,fma"))) float SumAvx2(const float* a, size_t n) {
+  __m256 acc = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc = _mm256_add_ps(acc, _mm256_loadu_ps(a + i));
+  }
+  float sum = HorizontalSum(acc);
+  for (; i < n; ++i) {
+    sum += a[i];
+  }
+  return sum;
+}
+
+__attribute__((target("avx2,fma"))) void MatVecAvx2(const float* a,
+                                                    const float* x, float* y,
+                                                    size_t m, size_t n) {
+  for (size_t i = 0; i < m; ++i) {
+    AxpyAvx2(x[i], a + i * n, y, n);
+  }
+}
+
+__attribute__((target("avx2,fma"))) void TransposedMatmulAvx2(
+    const float* a, const float* b, float* c, size_t m, size_t n, size_t k) {
+  for (size_t i = 0; i < m; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      AxpyAvx2(a[i * n + j], b + i * k, c + j * k, k);
+    }
+  }
+}
+
+// The AVX-512 kernels handle the tail with a masked load instead of a scalar
+// loop, which matters for the narrow layers in our models.
+__attribute__((target("avx512f"))) __mmask16 TailMask(size_t remaining) {
+  return remaining >= 16 ? 0xFFFF : (__mmask16(1) << remaining) - 1;
+}
+
+__attribute__((target("avx512f"))) float DotAvx512(const float* a,
+                                                   const float* b, size_t n) {
+  __m512 acc = _mm512_setzero_ps();
+  for (size_t i = 0; i < n; i += 16) {
+    __mmask16 mask = TailMask(n - i);
+    acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                          _mm512_maskz_loadu_ps(mask, b + i), acc);
+  }
+  return _mm512_reduce_add_ps(acc);
+}
+
+__attribute__((target("avx512f"))) void AxpyAvx512(float alpha,
+                                                   const float* x, float* y,
+                                                   size_t n) {
+  __m512 a = _mm512_set1_ps(alpha);
+  for (size_t i = 0; i < n; i += 16) {
+    __mmask16 mask = TailMask(n - i);
+    __m512 result = _mm512_fmadd_ps(a, _mm512_maskz_loadu_ps(mask, x + i),
+                                    _mm512_maskz_loadu_ps(mask, y + i));
+    _mm512_mask_storeu_ps(y + i, mask, result);
+  }
+}
+
+__attribute__((target("avx512f"))) float SumAvx512(const float* a, size_t n) {
+  __m512 acc = _mm512_setzero_ps();
+  for (size_t i = 0; i < n; i += 16) {
+    acc = _mm512_add_ps(acc, _mm512_maskz_loadu_ps(TailMask(n - i), a + i));
+  }
+  return _mm512_reduce_add_ps(acc);
+}
+
+__attribute__((target("avx512f"))) void MatVecAvx512(const float* a,
+                                                     const float* x, float* y,
+                                                     size_t m, size_t n) {
+  // Our layers are narrow, so keep the output row in a register when it fits.
+  if (n <= 16) {
+    __mmask16 mask = TailMask(n);
+    __m512 acc = _mm512_maskz_loadu_ps(mask, y);
+    for (size_t i = 0; i < m; ++i) {
+      acc = _mm512_fmadd_ps(_mm512_set1_ps(x[i]),
+                            _mm512_maskz_loadu_ps(mask, a + i * n), acc);
+    }
+    _mm512_mask_storeu_ps(y, mask, acc);
+    return;
+  }
+  for (size_t i = 0; i < m; ++i) {
+    AxpyAvx512(x[i], a + i * n, y, n);
+  }
+}
+
+__attribute__((target("avx512f"))) void TransposedMatmulAvx512(
+    const float* a, const float* b, float* c, size_t m, size_t n, size_t k) {
+  // Accumulate 8 rows of `c` in registers at a time, so that each pass over
+  // the batch produces 8 rows of the output.
+  constexpr size_t kBlock = 8;
+  for (size_t p = 0; p < k; p += 16) {
+    __mmask16 mask = TailMask(k - p);
+    size_t j = 0;
+    for (; j + kBlock <= n; j += kBlock) {
+      __m512 acc[kBlock];
+      for (size_t r = 0; r < kBlock; ++r) {
+        acc[r] = _mm512_maskz_loadu_ps(mask, c + (j + r) * k + p);
+      }
+      for (size_t i = 0; i < m; ++i) {
+        __m512 row = _mm512_maskz_loadu_ps(mask, b + i * k + p);
+        const float* scale = a + i * n + j;
+        for (size_t r = 0; r < kBlock; ++r) {
+          acc[r] = _mm512_fmadd_ps(_mm512_set1_ps(scale[r]), row, acc[r]);
+        }
+      }
+      for (size_t r = 0; r < kBlock; ++r) {
+        _mm512_mask_storeu_ps(c + (j + r) * k + p, mask, acc[r]);
+      }
+    }
+    for (; j < n; ++j) {
+      __m512 acc = _mm512_maskz_loadu_ps(mask, c + j * k + p);
+      for (size_t i = 0; i < m; ++i) {
+        acc = _mm512_fmadd_ps(_mm512_set1_ps(a[i * n + j]),
+                              _mm512_maskz_loadu_ps(mask, b + i * k + p), acc);
+      }
+      _mm512_mask_storeu_ps(c + j * k + p, mask, acc);
+    }
+  }
+}
+
+#endif
+
+struct Table {
+  float (*dot)(const float*, const float*, size_t);
+  void (*axpy)(float, const float*, float*, size_t);
+  float (*sum)(const float*, size_t);
+  void (*mat_vec)(const float*, const float*, float*, size_t, size_t);
+  void (*transposed_matmul)(const float*, const float*, float*, size_t, size_t,
+                            size_t);
+};
+
+const Table& Select() {
+  static const Table table = []() -> Table {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return {DotAvx512, AxpyAvx512, SumAvx512, MatVecAvx512,
+              TransposedMatmulAvx512};
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return {DotAvx2, AxpyAvx2, SumAvx2, MatVecAvx2, TransposedMatmulAvx2};
+    }
+#endif
+    return {DotScalar, AxpyScalar, SumScalar, MatVecScalar,
+            TransposedMatmulScalar};
+  }();
+  return table;
+}
+
+}  // namespace
+
+float Dot(const float* a, const float* b, size_t n) {
+  return Select().dot(a, b, n);
+}
+
+void Axpy(float alpha, const float* x, float* y, size_t n) {
+  Select().axpy(alpha, x, y, n);
+}
+
+float Sum(const float* a, size_t n) { return Select().sum(a, n); }
+
+void MatVec(const float* a, const float* x, float* y, size_t m, size_t n) {
+  Select().mat_vec(a, x, y, m, n);
+}
+
+void TransposedMatmul(const float* a, const float* b, float* c, size_t m,
+                      size_t n, size_t k) {
+  Select().transposed_matmul(a, b, c, m, n, k);
+}
+
+}  // namespace micrograd::kernels
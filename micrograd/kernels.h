@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+// Vectorized loops over contiguous floats.
+//
+// Each kernel has an AVX-512, an AVX2 and a scalar implementation, the best
+// one supported by the CPU is selected the first time it is called.
+namespace micrograd::kernels {
+
+// Returns the sum of a[i] * b[i].
+float Dot(const float* a, const float* b, size_t n);
+
+// Computes y[i] += alpha * x[i].
+void Axpy(float alpha, const float* x, float* y, size_t n);
+
+// Returns the sum of a[i].
+float Sum(const float* a, size_t n);
+
+// Computes y[j] += sum_i x[i] * a[i][j] for a row-major [m x n] matrix `a`.
+void MatVec(const float* a, const float* x, float* y, size_t m, size_t n);
+
+// Computes c += transpose(a) * b for row-major matrices, where `a` is
+// [m x n], `b` is [m x k] and `c` is [n x k].
+//
+// This is the gradient of the weights of a layer over a whole batch.
+void TransposedMatmul(const float* a, const float* b, float* c, size_t m,
+                      size_t n, size_t k);
+
+}  // namespace micrograd::kernels
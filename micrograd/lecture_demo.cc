@@ -2,51 +2,53 @@
 #include <iostream>
 
 #include "micrograd/nn.h"
+#include "micrograd/optimizer.h"
+#include "micrograd/program.h"
 
 namespace micrograd {
 
 namespace {
 Value SumOfSquares(std::span<const Value> expected,
                    std::span<const Value> predicted) {
-  Value loss = Value(0.0);
-  for (size_t i = 0; i < expected.size(); ++i) {
-    loss = loss.Add(predicted[i].Subtract(expected[i]).Pow(2));
-  }
-  return loss;
+  return MeanSquaredError(predicted, expected).Multiply(expected.size());
 }
 }  // namespace
 
 void Run() {
   auto stdout = std::ostreambuf_iterator<char>(std::cout);
-  std::vector<std::vector<Value>> inputs = {
-      {Value(2), Value(3), Value(-1)},
-      {Value(3), Value(-1), Value(0.5)},
-      {Value(0.5), Value(1.0), Value(1.0)},
-      {Value(1), Value(1), Value(-1)},
+  std::vector<float> inputs = {
+      2, 3, -1,     // first example
+      3, -1, 0.5,   // second example
+      0.5, 1, 1,    // third example
+      1, 1, -1,     // fourth example
+      1, -1, -1, 1  // targets
   };
-  std::vector<Value> targets = {Value(1), Value(-1), Value(-1), Value(1)};
   std::array layers = std::to_array<size_t>({4, 4, 1});
   auto n = MLP(3, layers);
-  for (size_t i = 0; i < 500; ++i) {
-    // Update
-    for (Value& p : n.Parameters()) {
-      p.value(p.value() + (-0.005 * p.gradient()));
-    }
-    // Compute forward pass
+  // The graph is the same every iteration, so trace it once and replay it.
+  auto program = Program(inputs, [&n](std::span<const Value> inputs) {
     std::vector<Value> outputs;
-    outputs.reserve(inputs.size());
-    for (const auto& input : inputs) {
-      auto output = n(input);
+    outputs.push_back(Value(0.0));
+    for (size_t i = 0; i < 4; ++i) {
+      auto output = n(inputs.subspan(3 * i, 3));
       outputs.push_back(std::move(output.front()));
     }
-    Value loss = SumOfSquares(targets, outputs);
-    for (Value& p : n.Parameters()) {
-      p.gradient(0.0);
-    }
-    loss.Backward();
-    std::format_to(stdout, "loss: {}\n", loss.value());
-    for (const Value& output : outputs) {
-      std::format_to(stdout, "output value: {}\n", output.value());
+    std::span<const Value> predicted = std::span(outputs).subspan(1);
+    outputs.front() = SumOfSquares(inputs.subspan(12), predicted);
+    return outputs;
+  });
+  program.Simplify();
+  auto optimizer = SGD(n.Parameters(), /*learning_rate=*/0.005);
+  for (size_t i = 0; i < 500; ++i) {
+    // Update
+    optimizer.Step();
+    // Compute forward pass
+    program.Forward(inputs);
+    optimizer.ZeroGrad();
+    program.Backward();
+    std::format_to(stdout, "loss: {}\n", program.output(0));
+    for (size_t j = 1; j < program.number_of_outputs(); ++j) {
+      std::format_to(stdout, "output value: {}\n", program.output(j));
     }
     std::format_to(stdout, "\n\n");
   }
@@ -1,146 +1,327 @@
 #include "micrograd/micrograd.h"
 
 #include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
 
-#include "absl/container/flat_hash_set.h"
+#include "micrograd/graph_export.h"
+#include "micrograd/instrumentation.h"
+#include "micrograd/tape.h"
+#include "micrograd/value_impl.h"
 
 namespace micrograd {
 
-namespace {
-enum class Op : char {
-  kNone = ' ',
-  kAdd = '+',
-  kMultiply = '*',
-  kPow = '^',
-  kReLU = '?',
-};
-}
-
-class ValueImpl : public std::enable_shared_from_this<ValueImpl> {
-  using ChildrenSet = absl::flat_hash_set<std::shared_ptr<ValueImpl>>;
-
- public:
-  ValueImpl(float val) : value_(val) {}
-  ValueImpl(float val, ChildrenSet children, Op op)
-      : value_(val), children_(children), op_(op) {}
-
-  std::shared_ptr<ValueImpl> Add(std::shared_ptr<ValueImpl> other) {
-    auto out = std::make_shared<ValueImpl>(
-        value_ + other->value_, ChildrenSet({shared_from_this(), other}),
-        Op::kAdd);
-    out->backward_ = [this, other = other.get(), out = out.get()] {
-      this->grad_ += out->grad_;
-      other->grad_ += out->grad_;
-    };
-    return out;
-  }
-
-  std::shared_ptr<ValueImpl> Multiply(std::shared_ptr<ValueImpl> other) {
-    auto out = std::make_shared<ValueImpl>(
-        value_ * other->value_, ChildrenSet({shared_from_this(), other}),
-        Op::kMultiply);
-    out->backward_ = [this, other = other.get(), out = out.get()] {
-      this->grad_ += other->value_ * out->grad_;
-      other->grad_ += this->value_ * out->grad_;
-    };
-    return out;
-  }
-
-  std::shared_ptr<ValueImpl> Pow(float other) {
-    auto out = std::make_shared<ValueImpl>(
-        std::pow(value_, other), ChildrenSet({shared_from_this()}), Op::kPow);
-    out->backward_ = [this, other, out = out.get()] {
-      this->grad_ += (other * std::pow(value_, other - 1)) * out->grad_;
-    };
-    return out;
-  }
-
-  std::shared_ptr<ValueImpl> Relu() {
-    auto out = std::make_shared<ValueImpl>(
-        value_ < 0 ? 0 : value_, ChildrenSet({shared_from_this()}), Op::kReLU);
-    out->backward_ = [this, out = out.get()] {
-      this->grad_ += out->value_ > 0 ? out->grad_ : 0;
-    };
-    return out;
-  }
-
-  void Backward() {
-    std::vector<ValueImpl*> output;
-    absl::flat_hash_set<ValueImpl*> visited;
-    TopologicalSort(&output, &visited);
-    grad_ = 1.0;
-    for (ssize_t i = output.size() - 1; i >= 0; --i) {
-      ValueImpl* v = output[i];
-      v->backward_();
-    }
-  }
-
-  float value() const { return value_; }
-  void value(float v) { value_ = v; }
-  float grad() const { return grad_; }
-  void grad(float v) { grad_ = v; }
-
-  std::string DebugString() const {
-    std::string children_debug_string = "{";
-    for (const auto& child : children_) {
-      children_debug_string += child->DebugString();
-    }
-    children_debug_string += "}";
-    return absl::StrFormat("Value(value=%f, grad=%f, op=%c, children=%s)",
-                           value_, grad_, op_, children_debug_string);
-  }
-
- private:
-  void TopologicalSort(std::vector<ValueImpl*>* output,
-                       absl::flat_hash_set<ValueImpl*>* visited) {
-    auto [_, inserted] = visited->insert(this);
-    if (!inserted) {
+template <Scalar T>
+BasicValue<T>::BasicValue(T data) {
+  MICROGRAD_COUNT_OP(Op::kNone);
+  if constexpr (kTaped) {
+    if (Tape* tape = Tape::Current()) {
+      tape_ = tape;
+      index_ = tape->Leaf(data);
       return;
     }
-    for (const auto& child : children_) {
-      child->TopologicalSort(output, visited);
+  }
+  impl_ = std::make_shared<ValueImpl<T>>(data);
+}
+
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Add(const BasicValue& other) const {
+  MICROGRAD_COUNT_OP(Op::kAdd);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(*this, other)) {
+      return BasicValue(tape,
+                        tape->Add(tape->Operand(*this), tape->Operand(other)));
+    }
+  }
+  return BasicValue(impl_->Add(other.impl_));
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Subtract(const BasicValue& other) const {
+  MICROGRAD_COUNT_OP(Op::kSubtract);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(*this, other)) {
+      return BasicValue(
+          tape, tape->Subtract(tape->Operand(*this), tape->Operand(other)));
+    }
+  }
+  return BasicValue(impl_->Subtract(other.impl_));
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Multiply(const BasicValue& other) const {
+  MICROGRAD_COUNT_OP(Op::kMultiply);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(*this, other)) {
+      return BasicValue(
+          tape, tape->Multiply(tape->Operand(*this), tape->Operand(other)));
+    }
+  }
+  return BasicValue(impl_->Multiply(other.impl_));
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Divide(const BasicValue& other) const {
+  MICROGRAD_COUNT_OP(Op::kDivide);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(*this, other)) {
+      return BasicValue(
+          tape, tape->Divide(tape->Operand(*this), tape->Operand(other)));
+    }
+  }
+  return BasicValue(impl_->Divide(other.impl_));
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Add(T other) const {
+  MICROGRAD_COUNT_OP(Op::kAddConstant);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(*this, *this)) {
+      return BasicValue(tape, tape->AddConstant(tape->Operand(*this), other));
+    }
+  }
+  return BasicValue(impl_->AddConstant(other));
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Subtract(T other) const {
+  return Add(T(-other));
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Multiply(T other) const {
+  MICROGRAD_COUNT_OP(Op::kMultiplyConstant);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(*this, *this)) {
+      return BasicValue(tape,
+                        tape->MultiplyConstant(tape->Operand(*this), other));
+    }
+  }
+  return BasicValue(impl_->MultiplyConstant(other));
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Divide(T other) const {
+  return Multiply(T(Accumulator<T>(1) / other));
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Pow(T other) const {
+  MICROGRAD_COUNT_OP(Op::kPow);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(*this, *this)) {
+      return BasicValue(tape, tape->Pow(tape->Operand(*this), other));
+    }
+  }
+  return BasicValue(impl_->Pow(other));
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Negate() const {
+  MICROGRAD_COUNT_OP(Op::kNegate);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(*this, *this)) {
+      return BasicValue(tape, tape->Negate(tape->Operand(*this)));
+    }
+  }
+  return BasicValue(impl_->Negate());
+}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::Relu() const {
+  MICROGRAD_COUNT_OP(Op::kReLU);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(*this, *this)) {
+      return BasicValue(tape, tape->Relu(tape->Operand(*this)));
+    }
+  }
+  return BasicValue(impl_->Relu());
+}
+template <Scalar T>
+void BasicValue<T>::Backward(bool retain_graph) {
+  MICROGRAD_TRACE_SCOPE("Backward");
+  if (tape_ != nullptr) {
+    tape_->Backward(index_);
+  } else {
+    impl_->Backward(retain_graph);
+  }
+}
+template <Scalar T>
+void BasicValue<T>::Backward(ThreadPool& pool, bool retain_graph) {
+  MICROGRAD_TRACE_SCOPE("Backward");
+  if (tape_ != nullptr) {
+    tape_->Backward(index_);
+  } else {
+    impl_->Backward(pool, retain_graph);
+  }
+}
+template <Scalar T>
+T BasicValue<T>::value() const {
+  if constexpr (kTaped) {
+    if (tape_ != nullptr) {
+      return tape_->value(index_);
+    }
+  }
+  return impl_->value();
+}
+template <Scalar T>
+void BasicValue<T>::value(T v) const {
+  if constexpr (kTaped) {
+    if (tape_ != nullptr) {
+      tape_->value(index_, v);
+      return;
+    }
+  }
+  impl_->value(v);
+}
+template <Scalar T>
+T BasicValue<T>::gradient() const {
+  if constexpr (kTaped) {
+    if (tape_ != nullptr) {
+      return tape_->grad(index_);
+    }
+  }
+  return impl_->grad();
+}
+template <Scalar T>
+void BasicValue<T>::gradient(T v) const {
+  if constexpr (kTaped) {
+    if (tape_ != nullptr) {
+      tape_->grad(index_, v);
+      return;
     }
-    output->push_back(this);
   }
+  impl_->grad(v);
+}
 
-  float value_;
-  float grad_ = 0.0;
-  absl::flat_hash_set<std::shared_ptr<ValueImpl>> children_;
-  absl::AnyInvocable<void()> backward_ = [] {};
-  Op op_ = Op::kNone;
-};
+template <Scalar T>
+BasicValue<T>::BasicValue(std::shared_ptr<ValueImpl<T>> impl)
+    : impl_(std::move(impl)) {}
 
-Value::Value(float data) : impl_(std::make_shared<ValueImpl>(data)) {}
+template <Scalar T>
+BasicValue<T>::BasicValue(Tape* tape, uint32_t index)
+    : tape_(tape), index_(index) {}
 
-Value Value::Add(const Value& other) const {
-  return Value(impl_->Add(other.impl_));
+template <Scalar T>
+std::string BasicValue<T>::DebugString() const {
+  std::ostringstream out;
+  WriteJson(*this, out);
+  return std::move(out).str();
 }
-Value Value::Subtract(const Value& other) const {
-  return Value(impl_->Add(other.Negate().impl_));
+
+template <Scalar T>
+Tape* BasicValue<T>::TapeFor(std::span<const BasicValue> values) {
+  for (const BasicValue& v : values) {
+    if (v.tape_ != nullptr) {
+      return v.tape_;
+    }
+  }
+  return Tape::Current();
 }
-Value Value::Multiply(const Value& other) const {
-  return Value(impl_->Multiply(other.impl_));
+
+template <Scalar T>
+Tape* BasicValue<T>::TapeFor(const BasicValue& a, const BasicValue& b) {
+  if (a.tape_ != nullptr) {
+    return a.tape_;
+  }
+  if (b.tape_ != nullptr) {
+    return b.tape_;
+  }
+  return Tape::Current();
 }
-Value Value::Divide(const Value& other) const {
-  return Value(impl_->Multiply(other.Pow(-1).impl_));
+
+template <Scalar T>
+BasicValue<T> BasicValue<T>::DotOf(std::span<const BasicValue> w,
+                                   std::span<const BasicValue> x) {
+  if (w.size() != x.size()) {
+    throw std::invalid_argument("dot product of different lengths");
+  }
+  MICROGRAD_COUNT_OP(Op::kDot);
+  if constexpr (kTaped) {
+    Tape* tape = TapeFor(w);
+    if (tape == nullptr) {
+      tape = TapeFor(x);
+    }
+    if (tape != nullptr) {
+      return BasicValue(tape, tape->Dot(w, x));
+    }
+  }
+  std::vector<std::shared_ptr<ValueImpl<T>>> operands;
+  operands.reserve(w.size() + x.size());
+  for (const BasicValue& v : w) {
+    operands.push_back(v.impl_);
+  }
+  for (const BasicValue& v : x) {
+    operands.push_back(v.impl_);
+  }
+  return BasicValue(ValueImpl<T>::Dot(operands));
+}
+
+template <Scalar T>
+BasicValue<T> BasicValue<T>::SumOf(std::span<const BasicValue> values) {
+  MICROGRAD_COUNT_OP(Op::kSum);
+  if constexpr (kTaped) {
+    if (Tape* tape = TapeFor(values)) {
+      return BasicValue(tape, tape->Sum(values));
+    }
+  }
+  std::vector<std::shared_ptr<ValueImpl<T>>> operands;
+  operands.reserve(values.size());
+  for (const BasicValue& v : values) {
+    operands.push_back(v.impl_);
+  }
+  return BasicValue(ValueImpl<T>::Sum(operands));
 }
-Value Value::Pow(float other) const { return Value(impl_->Pow(other)); }
-Value Value::Negate() const { return this->Multiply(-1); }
-Value Value::Relu() const { return Value(impl_->Relu()); }
-void Value::Backward() { impl_->Backward(); }
-float Value::value() const { return impl_->value(); }
-void Value::value(float v) { impl_->value(v); }
-float Value::gradient() const { return impl_->grad(); }
-void Value::gradient(float v) { impl_->grad(v); }
 
-Value::Value(std::shared_ptr<ValueImpl> impl) : impl_(std::move(impl)) {}
+template <Scalar T>
+BasicValue<T> BasicValue<T>::HingeLossOf(
+    std::span<const BasicValue> predictions,
+    std::span<const BasicValue> targets) {
+  return LossOf(Op::kHinge, predictions, targets, 1);
+}
 
-void Value::HashValue(absl::HashState state, const ValueImpl& impl) {
-  absl::HashState::combine(std::move(state), std::addressof(impl));
+template <Scalar T>
+BasicValue<T> BasicValue<T>::MeanSquaredErrorOf(
+    std::span<const BasicValue> predictions,
+    std::span<const BasicValue> targets) {
+  return LossOf(Op::kMeanSquaredError, predictions, targets, 1);
 }
 
-std::string Value::DebugString(const ValueImpl& impl) {
-  return impl.DebugString();
+template <Scalar T>
+BasicValue<T> BasicValue<T>::SoftmaxCrossEntropyOf(
+    std::span<const BasicValue> logits, std::span<const BasicValue> targets,
+    size_t classes) {
+  if (classes == 0 || logits.size() % classes != 0) {
+    throw std::invalid_argument("logits are not rows of classes");
+  }
+  return LossOf(Op::kSoftmaxCrossEntropy, logits, targets, classes);
 }
 
+template <Scalar T>
+BasicValue<T> BasicValue<T>::LossOf(Op op,
+                                    std::span<const BasicValue> predictions,
+                                    std::span<const BasicValue> targets,
+                                    size_t classes) {
+  if (predictions.size() != targets.size()) {
+    throw std::invalid_argument("loss of different lengths");
+  }
+  if (predictions.empty()) {
+    throw std::invalid_argument("loss of no predictions");
+  }
+  MICROGRAD_COUNT_OP(op);
+  if constexpr (kTaped) {
+    Tape* tape = TapeFor(predictions);
+    if (tape == nullptr) {
+      tape = TapeFor(targets);
+    }
+    if (tape != nullptr) {
+      return BasicValue(tape, tape->Loss(op, predictions, targets, classes));
+    }
+  }
+  std::vector<std::shared_ptr<ValueImpl<T>>> operands;
+  operands.reserve(predictions.size() + targets.size());
+  for (const BasicValue& v : predictions) {
+    operands.push_back(v.impl_);
+  }
+  for (const BasicValue& v : targets) {
+    operands.push_back(v.impl_);
+  }
+  return BasicValue(ValueImpl<T>::Loss(op, classes, operands));
+}
+
+template class BasicValue<float>;
+template class BasicValue<double>;
+template class BasicValue<BFloat16>;
+
 }  // namespace micrograd
@@ -1,13 +1,23 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
 #include <utility>
 
 #include "absl/hash/hash.h"
 #include "absl/strings/str_format.h"
+#include "micrograd/scalar.h"
 
 namespace micrograd {
 
+enum class Op : char;
+class Tape;
+class ThreadPool;
+template <Scalar T>
 class ValueImpl;
 
 /**
@@ -16,55 +26,179 @@ class ValueImpl;
  *
  * This value class is a small wrapper over a shared pointer, so it is
  * copy-able, but the underlying value is still the same.
+ *
+ * The scalar type `T` of the values and gradients is chosen at compile time:
+ * `Value` uses floats, `double` is useful for accurate gradient checks and
+ * `BFloat16` halves the memory of large graphs.
+ *
+ * When a `Tape::Scope` is active, float values are instead recorded on the
+ * tape and this class is only a handle into it, see `Tape` for more
+ * information. Values of other types are always allocated on the heap.
  */
-class Value {
+template <Scalar T>
+class BasicValue {
  public:
-  explicit Value(float data);
-
-  Value Add(const Value& other) const;
-  Value Add(float other) const { return Add(Value(other)); }
-  Value Subtract(const Value& other) const;
-  Value Subtract(float other) const { return Subtract(Value(other)); }
+  explicit BasicValue(T data);
+
+  BasicValue Add(const BasicValue& other) const;
+  BasicValue Subtract(const BasicValue& other) const;
+  BasicValue Multiply(const BasicValue& other) const;
+  BasicValue Divide(const BasicValue& other) const;
+
+  // Operations with a constant are a single node that stores the constant,
+  // instead of a node for the constant and one for the operation.
+  BasicValue Add(T other) const;
+  BasicValue Subtract(T other) const;
+  BasicValue Multiply(T other) const;
+  // Multiplies by the reciprocal of `other`, which may round differently
+  // than dividing by it.
+  BasicValue Divide(T other) const;
+
+  BasicValue Pow(T other) const;
+  BasicValue Negate() const;
+  BasicValue Relu() const;
+
+  T value() const;
+  void value(T) const;
+  T gradient() const;
+  void gradient(T) const;
 
-  Value Multiply(const Value& other) const;
-  Value Multiply(float other) const { return Multiply(Value(other)); }
-  Value Divide(const Value& other) const;
-  Value Divide(float other) const { return Divide(Value(other)); }
+  /**
+   * Populate the gradient for this node and all it's children.
+   *
+   * Unless `retain_graph`, the graph is released during the pass, like
+   * `retain_graph=False` in PyTorch: once the gradient of a node has been
+   * propagated to its children, its backward function and its references to
+   * its children are dropped. Nodes that are only owned by the graph are
+   * freed right away instead of when the last value that refers to the graph
+   * goes away. Nodes that are still held elsewhere (such as parameters or
+   * intermediate results) keep their value and gradient, but become leaves,
+   * so the graph can't be back propagated again.
+   *
+   * Values recorded on a tape ignore `retain_graph`, as the tape is reset
+   * instead.
+   */
+  void Backward(bool retain_graph = true);
+  /**
+   * The same as `Backward`, but independent nodes are back propagated
+   * concurrently using the threads of `pool`. This pays off for wide graphs,
+   * such as a layer over a whole batch.
+   *
+   * Values recorded on a tape are back propagated serially.
+   */
+  void Backward(ThreadPool& pool, bool retain_graph = true);
 
-  Value Pow(float other) const;
-  Value Negate() const;
-  Value Relu() const;
+  /**
+   * The dot product of `w` and `x`, as a single node in the graph.
+   *
+   * Compared to a chain of `Multiply` and `Add`, this is one node instead of
+   * 2 * n, and both passes run as a single vectorized loop.
+   *
+   * Both spans must be the same length.
+   */
+  friend BasicValue Dot(std::span<const BasicValue> w,
+                        std::span<const BasicValue> x) {
+    return DotOf(w, x);
+  }
 
-  float value() const;
-  void value(float);
-  float gradient() const;
-  void gradient(float);
+  /**
+   * The sum of all `values`, as a single node in the graph.
+   */
+  friend BasicValue Sum(std::span<const BasicValue> values) {
+    return SumOf(values);
+  }
 
   /**
-   * Populate the gradient for this node and all it's children.
+   * Loss functions of `predictions` and `targets`, which must be the same
+   * non-empty length, each as a single node in the graph.
+   *
+   * Compared to building the loss out of scalar operations, this is one node
+   * instead of several per prediction, and the gradients of all the
+   * predictions and targets are computed analytically in a single loop.
    */
-  void Backward();
+  // The mean of max(0, 1 - targets[i] * predictions[i]), the max-margin loss
+  // of a binary classifier with targets of -1 and 1.
+  friend BasicValue HingeLoss(std::span<const BasicValue> predictions,
+                              std::span<const BasicValue> targets) {
+    return HingeLossOf(predictions, targets);
+  }
+  // The mean of (predictions[i] - targets[i])^2.
+  friend BasicValue MeanSquaredError(std::span<const BasicValue> predictions,
+                                     std::span<const BasicValue> targets) {
+    return MeanSquaredErrorOf(predictions, targets);
+  }
+  // The mean over rows of `classes` logits of the cross-entropy between the
+  // softmax of the logits and the target probabilities of each class (such
+  // as a one-hot encoding of the labels).
+  friend BasicValue SoftmaxCrossEntropy(std::span<const BasicValue> logits,
+                                        std::span<const BasicValue> targets,
+                                        size_t classes) {
+    return SoftmaxCrossEntropyOf(logits, targets, classes);
+  }
 
   template <typename H>
-  friend H AbslHashValue(H h, const Value& v) {
-    HashValue(absl::HashState::Create(&h), *v.impl_.get());
-    return std::move(h);
+  friend H AbslHashValue(H h, const BasicValue& v) {
+    return H::combine(std::move(h), v.impl_.get(), v.tape_, v.index_);
   }
 
   template <typename Sink>
-  friend void AbslStringify(Sink& sink, const Value& p) {
-    absl::Format(&sink, "%s", DebugString(*p.impl_.get()));
+  friend void AbslStringify(Sink& sink, const BasicValue& p) {
+    absl::Format(&sink, "%s", p.DebugString());
   }
 
-  bool operator==(const Value&) const = default;
+  bool operator==(const BasicValue&) const = default;
 
  private:
-  explicit Value(std::shared_ptr<ValueImpl> impl);
+  template <Scalar>
+  friend class BasicParameterBuffer;
+  friend class DataParallel;
+  template <Scalar>
+  friend class GraphWriter;
+  friend class Optimizer;
+  friend class Program;
+  friend class Tape;
+
+  // Only floats can be recorded on a tape.
+  static constexpr bool kTaped = std::is_same_v<T, float>;
+
+  explicit BasicValue(std::shared_ptr<ValueImpl<T>> impl);
+  BasicValue(Tape* tape, uint32_t index);
+
+  // The tape an operation over `a` and `b` should be recorded on, or nullptr
+  // if it should be allocated on the heap.
+  static Tape* TapeFor(const BasicValue& a, const BasicValue& b);
+  static Tape* TapeFor(std::span<const BasicValue> values);
+
+  static BasicValue DotOf(std::span<const BasicValue> w,
+                          std::span<const BasicValue> x);
+  static BasicValue SumOf(std::span<const BasicValue> values);
+  static BasicValue HingeLossOf(std::span<const BasicValue> predictions,
+                                std::span<const BasicValue> targets);
+  static BasicValue MeanSquaredErrorOf(
+      std::span<const BasicValue> predictions,
+      std::span<const BasicValue> targets);
+  static BasicValue SoftmaxCrossEntropyOf(std::span<const BasicValue> logits,
+                                          std::span<const BasicValue> targets,
+                                          size_t classes);
+  // A loss function (`op`) of `predictions` and `targets`.
+  static BasicValue LossOf(Op op, std::span<const BasicValue> predictions,
+                           std::span<const BasicValue> targets,
+                           size_t classes);
+
+  // The graph of this value as JSON, see `WriteJson`.
+  std::string DebugString() const;
+
+  // Set when the value lives on the heap.
+  std::shared_ptr<ValueImpl<T>> impl_;
+  // Set when the value is recorded on a tape.
+  Tape* tape_ = nullptr;
+  uint32_t index_ = 0;
+};
 
-  static void HashValue(absl::HashState state, const ValueImpl&);
-  static std::string DebugString(const ValueImpl&);
+using Value = BasicValue<float>;
 
-  std::shared_ptr<ValueImpl> impl_;
-};
+extern template class BasicValue<float>;
+extern template class BasicValue<double>;
+extern template class BasicValue<BFloat16>;
 
 }  // namespace micrograd
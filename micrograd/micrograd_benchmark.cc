@@ -0,0 +1,369 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <optional>
+#include <vector>
+
+#include "micrograd/allocation_counter.h"
+#include "micrograd/micrograd.h"
+#include "micrograd/nn.h"
+#include "micrograd/optimizer.h"
+#include "micrograd/program.h"
+#include "micrograd/scalar.h"
+#include "micrograd/tape.h"
+#include "micrograd/value_impl.h"
+
+namespace micrograd {
+namespace {
+
+namespace counter = allocation_counter;
+
+// Reports the allocations per iteration and the peak of the heap memory that
+// was live at once above what was live at the start when it goes out of
+// scope, and the rate of `nodes` if any. Unlike the peak RSS of the process,
+// which only ever grows, the peak is measured for each benchmark on its own.
+class Counters {
+ public:
+  explicit Counters(benchmark::State& state)
+      : state_(state),
+        allocations_(counter::allocations()),
+        allocated_bytes_(counter::allocated_bytes()),
+        live_bytes_(counter::live_bytes()) {
+    counter::ResetPeak();
+  }
+  Counters(const Counters&) = delete;
+  Counters& operator=(const Counters&) = delete;
+
+  ~Counters() {
+    auto per_iteration = [this](size_t n) {
+      return benchmark::Counter(n, benchmark::Counter::kAvgIterations);
+    };
+    state_.counters["allocs"] =
+        per_iteration(counter::allocations() - allocations_);
+    state_.counters["bytes"] =
+        per_iteration(counter::allocated_bytes() - allocated_bytes_);
+    state_.counters["peak_live_bytes"] =
+        counter::peak_live_bytes() - live_bytes_;
+    if (nodes_ > 0) {
+      state_.counters["nodes"] = benchmark::Counter(
+          nodes_ * state_.iterations(), benchmark::Counter::kIsRate);
+    }
+  }
+
+  // The number of graph nodes that are created or visited per iteration.
+  void nodes(size_t n) { nodes_ = n; }
+
+ private:
+  benchmark::State& state_;
+  size_t allocations_;
+  size_t allocated_bytes_;
+  size_t live_bytes_;
+  size_t nodes_ = 0;
+};
+
+enum class Engine { kGraph, kTape };
+
+// Run `fn` with the values it creates recorded according to `engine`.
+template <typename F>
+void WithEngine(Engine engine, Tape& tape, F fn) {
+  if (engine == Engine::kTape) {
+    tape.Reset();
+    Tape::Scope scope(&tape);
+    fn();
+  } else {
+    fn();
+  }
+}
+
+template <typename Op>
+void BM_Op(benchmark::State& state, Op op) {
+  auto engine = static_cast<Engine>(state.range(1));
+  size_t n = state.range(0);
+  Tape tape;
+  Counters counters(state);
+  for (auto _ : state) {
+    WithEngine(engine, tape, [&] {
+      Value v = Value(0.5);
+      for (size_t i = 0; i < n; ++i) {
+        v = op(v);
+      }
+      benchmark::DoNotOptimize(v);
+    });
+  }
+  counters.nodes(n);
+}
+
+void OpArguments(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"n", "tape"});
+  for (int engine : {0, 1}) {
+    b->Args({1 << 12, engine});
+  }
+}
+
+BENCHMARK_CAPTURE(BM_Op, Add, [](const Value& v) { return v.Add(v); })
+    ->Apply(OpArguments);
+BENCHMARK_CAPTURE(BM_Op, Multiply,
+                  [](const Value& v) { return v.Multiply(v); })
+    ->Apply(OpArguments);
+BENCHMARK_CAPTURE(BM_Op, Pow, [](const Value& v) { return v.Pow(1.0); })
+    ->Apply(OpArguments);
+BENCHMARK_CAPTURE(BM_Op, Relu, [](const Value& v) { return v.Relu(); })
+    ->Apply(OpArguments);
+
+// A long chain of additions, the deepest graph for its size.
+void BM_BackwardChain(benchmark::State& state) {
+  auto engine = static_cast<Engine>(state.range(1));
+  size_t n = state.range(0);
+  Tape tape;
+  WithEngine(engine, tape, [&] {
+    Value x = Value(1.0);
+    Value v = x;
+    for (size_t i = 0; i < n; ++i) {
+      v = v.Add(x);
+    }
+    Counters counters(state);
+    for (auto _ : state) {
+      v.Backward();
+    }
+    counters.nodes(n);
+  });
+}
+BENCHMARK(BM_BackwardChain)
+    ->ArgNames({"n", "tape"})
+    ->ArgsProduct({{1 << 8, 1 << 12, 1 << 18}, {0, 1}});
+
+// The sum of many independent products, the widest graph for its size.
+void BM_BackwardWide(benchmark::State& state) {
+  auto engine = static_cast<Engine>(state.range(1));
+  size_t n = state.range(0);
+  Tape tape;
+  WithEngine(engine, tape, [&] {
+    std::vector<Value> products;
+    for (size_t i = 0; i < n; ++i) {
+      products.push_back(Value(i).Multiply(Value(1.0 / (i + 1))));
+    }
+    Value v = Sum(products);
+    Counters counters(state);
+    for (auto _ : state) {
+      v.Backward();
+    }
+    counters.nodes(3 * n);
+  });
+}
+BENCHMARK(BM_BackwardWide)
+    ->ArgNames({"n", "tape"})
+    ->ArgsProduct({{1 << 8, 1 << 12, 1 << 16}, {0, 1}});
+
+std::vector<Value> Inputs(size_t n) {
+  std::vector<Value> inputs;
+  for (size_t i = 0; i < n; ++i) {
+    inputs.push_back(Value(std::sin(i)));
+  }
+  return inputs;
+}
+
+void BM_NeuronForward(benchmark::State& state) {
+  auto engine = static_cast<Engine>(state.range(1));
+  size_t width = state.range(0);
+  auto neuron = Neuron(width);
+  Tape tape;
+  Counters counters(state);
+  for (auto _ : state) {
+    WithEngine(engine, tape, [&] {
+      std::vector<Value> x = Inputs(width);
+      benchmark::DoNotOptimize(neuron(x));
+    });
+  }
+}
+BENCHMARK(BM_NeuronForward)
+    ->ArgNames({"width", "tape"})
+    ->ArgsProduct({{16, 256, 4096}, {0, 1}});
+
+void BM_LayerForward(benchmark::State& state) {
+  auto engine = static_cast<Engine>(state.range(1));
+  size_t width = state.range(0);
+  auto layer = Layer(width, width);
+  Tape tape;
+  Counters counters(state);
+  for (auto _ : state) {
+    WithEngine(engine, tape, [&] {
+      std::vector<Value> x = Inputs(width);
+      benchmark::DoNotOptimize(layer(x));
+    });
+  }
+}
+BENCHMARK(BM_LayerForward)
+    ->ArgNames({"width", "tape"})
+    ->ArgsProduct({{16, 64, 256}, {0, 1}});
+
+void BM_MLPForward(benchmark::State& state) {
+  auto engine = static_cast<Engine>(state.range(1));
+  size_t width = state.range(0);
+  auto model = MLP(2, std::vector<size_t>{width, width, 1});
+  Tape tape;
+  Counters counters(state);
+  for (auto _ : state) {
+    WithEngine(engine, tape, [&] {
+      std::vector<Value> x = Inputs(2);
+      benchmark::DoNotOptimize(model(x));
+    });
+  }
+}
+BENCHMARK(BM_MLPForward)
+    ->ArgNames({"width", "tape"})
+    ->ArgsProduct({{16, 64, 256}, {0, 1}});
+
+void BM_MLPEvaluate(benchmark::State& state) {
+  size_t width = state.range(0);
+  auto model = MLP(2, std::vector<size_t>{width, width, 1});
+  std::vector<float> x = {0.5, -0.25};
+  Counters counters(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(model.Evaluate(x));
+  }
+}
+BENCHMARK(BM_MLPEvaluate)->ArgName("width")->Arg(16)->Arg(64)->Arg(256);
+
+void BM_MLPParameters(benchmark::State& state) {
+  size_t width = state.range(0);
+  auto model = MLP(2, std::vector<size_t>{width, width, 1});
+  Counters counters(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(model.Parameters());
+  }
+}
+BENCHMARK(BM_MLPParameters)->ArgName("width")->Arg(16)->Arg(256);
+
+// The same training step as nn_demo: the max-margin loss of a 16x16 MLP over
+// a batch of two interleaving half circles, plus L2 regularization.
+//
+// The heap graph engines hold on to the loss of the previous step until the
+// next one, like a training loop that reports it. With `kReleased`, its
+// graph is released by the backward pass, so the graphs of two steps are
+// never alive at the same time.
+void BM_TrainStep(benchmark::State& state) {
+  enum { kGraph, kTape, kProgram, kReleased };
+  size_t n = state.range(0);
+  int engine = state.range(1);
+  auto model = MLP(2, std::vector<size_t>{16, 16, 1});
+  std::span<const Value> parameters = model.Parameters();
+  auto optimizer = SGD(parameters, /*learning_rate=*/0.1);
+  std::vector<float> inputs;
+  for (size_t i = 0; i < n; ++i) {
+    float t = M_PI * i / n;
+    bool outer = i % 2 == 0;
+    inputs.push_back(outer ? std::cos(t) : 1 - std::cos(t));
+    inputs.push_back(outer ? std::sin(t) : 0.5 - std::sin(t));
+  }
+  for (size_t i = 0; i < n; ++i) {
+    inputs.push_back(i % 2 == 0 ? -1 : 1);
+  }
+  auto loss = [&](std::span<const Value> inputs) {
+    std::vector<Value> scores;
+    for (size_t i = 0; i < n; ++i) {
+      scores.push_back(model(inputs.subspan(2 * i, 2)).front());
+    }
+    Value data_loss = HingeLoss(scores, inputs.subspan(2 * n));
+    Value reg_loss = Dot(parameters, parameters).Multiply(1e-4);
+    return std::vector<Value>{data_loss.Add(reg_loss)};
+  };
+  auto program = Program(inputs, loss);
+  program.Simplify();
+  Tape tape;
+  std::optional<Value> last_loss;
+  Counters counters(state);
+  for (auto _ : state) {
+    optimizer.ZeroGrad();
+    if (engine == kProgram) {
+      program.Forward(inputs);
+      program.Backward();
+    } else {
+      WithEngine(engine == kTape ? Engine::kTape : Engine::kGraph, tape, [&] {
+        std::vector<Value> values;
+        for (float input : inputs) {
+          values.push_back(Value(input));
+        }
+        Value total_loss = loss(values).front();
+        total_loss.Backward(/*retain_graph=*/engine != kReleased);
+        if (engine != kTape) {
+          last_loss = total_loss;
+        }
+      });
+    }
+    optimizer.Step();
+  }
+  counters.nodes(program.size());
+}
+BENCHMARK(BM_TrainStep)
+    ->ArgNames({"points", "engine"})
+    ->ArgsProduct({{100, 1000}, {0, 1, 2, 3}})
+    ->Unit(benchmark::kMillisecond);
+
+// A training step of an MLP over scalars of type `T` on the heap graph, to
+// compare the memory and speed of each scalar type. Besides the counters of
+// every benchmark, this reports the size of a graph node and of the
+// parameters.
+template <Scalar T>
+void BM_ScalarTrainStep(benchmark::State& state) {
+  constexpr size_t kPoints = 16;
+  size_t width = state.range(0);
+  auto model = BasicMLP<T>(2, std::vector<size_t>{width, width, 1});
+  Counters counters(state);
+  for (auto _ : state) {
+    for (const BasicValue<T>& p : model.Parameters()) {
+      p.gradient(0);
+    }
+    std::vector<BasicValue<T>> scores;
+    for (size_t i = 0; i < kPoints; ++i) {
+      std::vector<BasicValue<T>> x = {BasicValue<T>(std::sin(i)),
+                                      BasicValue<T>(std::cos(i))};
+      scores.push_back(model(x).front().Pow(2));
+    }
+    Sum(scores).Backward();
+  }
+  state.counters["node_bytes"] = sizeof(ValueImpl<T>);
+  state.counters["parameter_bytes"] = model.ParameterValues().size_bytes();
+}
+BENCHMARK_TEMPLATE(BM_ScalarTrainStep, float)
+    ->ArgName("width")
+    ->Arg(16)
+    ->Arg(64);
+BENCHMARK_TEMPLATE(BM_ScalarTrainStep, double)
+    ->ArgName("width")
+    ->Arg(16)
+    ->Arg(64);
+BENCHMARK_TEMPLATE(BM_ScalarTrainStep, BFloat16)
+    ->ArgName("width")
+    ->Arg(16)
+    ->Arg(64);
+
+// Inference over the parameters of a wide MLP, which is bound by reading the
+// parameters from memory.
+template <Scalar T>
+void BM_ScalarEvaluate(benchmark::State& state) {
+  size_t width = state.range(0);
+  auto model = BasicMLP<T>(2, std::vector<size_t>{width, width, 1});
+  std::vector<T> x = {T(0.5f), T(-0.25f)};
+  Counters counters(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(model.Evaluate(x));
+  }
+  state.counters["parameter_bytes"] = model.ParameterValues().size_bytes();
+}
+BENCHMARK_TEMPLATE(BM_ScalarEvaluate, float)
+    ->ArgName("width")
+    ->Arg(256)
+    ->Arg(2048);
+BENCHMARK_TEMPLATE(BM_ScalarEvaluate, double)
+    ->ArgName("width")
+    ->Arg(256)
+    ->Arg(2048);
+BENCHMARK_TEMPLATE(BM_ScalarEvaluate, BFloat16)
+    ->ArgName("width")
+    ->Arg(256)
+    ->Arg(2048);
+
+}  // namespace
+}  // namespace micrograd
+
+BENCHMARK_MAIN();
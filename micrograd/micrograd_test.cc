@@ -3,6 +3,15 @@
 #include <gtest/gtest.h>
 #include <torch/nn.h>
 
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+#include "micrograd/instrumentation.h"
+#include "micrograd/nn.h"
+#include "micrograd/tape.h"
+#include "micrograd/thread_pool.h"
+
 namespace micrograd {
 
 TEST(MicrogradValue, SimpleExpression) {
@@ -106,4 +115,410 @@ TEST(MicrogradValue, AllOps) {
   }
 }
 
+TEST(MicrogradValue, SubtractDivideNegate) {
+  for (bool taped : {false, true}) {
+    Tape tape;
+    std::optional<Tape::Scope> scope;
+    if (taped) {
+      scope.emplace(&tape);
+    }
+    auto x = Value(3);
+    auto y = Value(-2);
+    // The same operand on both sides gets both gradients.
+    auto out = x.Subtract(y).Divide(y).Add(x.Negate()).Add(x.Divide(x));
+    out = out.Subtract(y.Subtract(y)).Subtract(0.5).Divide(0.5);
+    out.Backward();
+    EXPECT_FLOAT_EQ(out.value(), -10);
+    EXPECT_FLOAT_EQ(x.gradient(), 2 * (1 / -2.0 - 1));
+    EXPECT_FLOAT_EQ(y.gradient(), 2 * (-3 / 4.0));
+    if (taped) {
+      // Each operation is a single node, even with a constant operand.
+      EXPECT_EQ(tape.size(), 12);
+    }
+  }
+}
+
+TEST(MicrogradValue, Losses) {
+  auto values_of = [](const std::vector<float>& values) {
+    std::vector<Value> out;
+    for (float v : values) {
+      out.push_back(Value(v));
+    }
+    return out;
+  };
+  // Each loss is checked against the same loss built out of scalar
+  // operations, which has at least one node per prediction.
+  auto expect_same = [&](auto fused_loss, auto scalar_loss) {
+    std::vector<float> p = {0.5, -2, 1.5, 0.25, 3};
+    std::vector<float> t = {1, -1, -1, 1, -1};
+    for (bool taped : {false, true}) {
+      Tape tape;
+      std::optional<Tape::Scope> scope;
+      if (taped) {
+        scope.emplace(&tape);
+      }
+      std::vector<Value> fused_p = values_of(p);
+      std::vector<Value> fused_t = values_of(t);
+      std::vector<Value> scalar_p = values_of(p);
+      std::vector<Value> scalar_t = values_of(t);
+      size_t leaves = taped ? tape.size() : 0;
+      Value fused = fused_loss(fused_p, fused_t);
+      if (taped) {
+        EXPECT_EQ(tape.size(), leaves + 1);
+      }
+      Value expected = scalar_loss(scalar_p, scalar_t);
+      fused.Backward();
+      expected.Backward();
+      EXPECT_FLOAT_EQ(fused.value(), expected.value());
+      for (size_t i = 0; i < p.size(); ++i) {
+        EXPECT_FLOAT_EQ(fused_p[i].gradient(), scalar_p[i].gradient());
+        EXPECT_FLOAT_EQ(fused_t[i].gradient(), scalar_t[i].gradient());
+      }
+    }
+  };
+  expect_same(
+      [](std::span<const Value> p, std::span<const Value> t) {
+        return HingeLoss(p, t);
+      },
+      [](std::span<const Value> p, std::span<const Value> t) {
+        std::vector<Value> losses;
+        for (size_t i = 0; i < p.size(); ++i) {
+          losses.push_back(t[i].Multiply(p[i]).Negate().Add(1).Relu());
+        }
+        return Sum(losses).Divide(p.size());
+      });
+  expect_same(
+      [](std::span<const Value> p, std::span<const Value> t) {
+        return MeanSquaredError(p, t);
+      },
+      [](std::span<const Value> p, std::span<const Value> t) {
+        std::vector<Value> losses;
+        for (size_t i = 0; i < p.size(); ++i) {
+          losses.push_back(p[i].Subtract(t[i]).Pow(2));
+        }
+        return Sum(losses).Divide(p.size());
+      });
+
+  // There is no exp op to build the softmax from, so compare with the
+  // analytic gradient instead: softmax(logits) - targets for the logits, and
+  // -log(softmax(logits)) for the targets, both divided by the rows.
+  auto logits = values_of({1, 2, 3, -1, 0, 1});
+  auto targets = values_of({0, 0, 1, 1, 0, 0});
+  Value loss = SoftmaxCrossEntropy(logits, targets, 3);
+  loss.Backward();
+  std::vector<float> log_softmax;
+  for (size_t row = 0; row < 6; row += 3) {
+    float log_sum = 0;
+    for (size_t i = row; i < row + 3; ++i) {
+      log_sum += std::exp(logits[i].value());
+    }
+    log_sum = std::log(log_sum);
+    for (size_t i = row; i < row + 3; ++i) {
+      log_softmax.push_back(logits[i].value() - log_sum);
+    }
+  }
+  EXPECT_FLOAT_EQ(loss.value(), -(log_softmax[2] + log_softmax[3]) / 2);
+  for (size_t i = 0; i < logits.size(); ++i) {
+    EXPECT_FLOAT_EQ(logits[i].gradient(),
+                    (std::exp(log_softmax[i]) - targets[i].value()) / 2);
+    EXPECT_FLOAT_EQ(targets[i].gradient(), -log_softmax[i] / 2);
+  }
+
+  EXPECT_THROW(HingeLoss(logits, std::span(targets).first(2)),
+               std::invalid_argument);
+  EXPECT_THROW(MeanSquaredError(std::span<const Value>(), {}),
+               std::invalid_argument);
+  EXPECT_THROW(SoftmaxCrossEntropy(logits, targets, 4), std::invalid_argument);
+}
+
+TEST(MicrogradValue, DeepGraph) {
+  auto x = Value(0.5);
+  auto loss = Value(0.0);
+  for (int i = 0; i < 10'000; ++i) {
+    loss = loss.Add(x.Multiply(x));
+  }
+  EXPECT_FLOAT_EQ(loss.value(), 2'500);
+  loss.Backward();
+  EXPECT_FLOAT_EQ(x.gradient(), 10'000);
+  // The topological order is reused on later passes.
+  x.gradient(0.0);
+  loss.Backward();
+  EXPECT_FLOAT_EQ(x.gradient(), 10'000);
+}
+
+TEST(MicrogradValue, DeepGraphTeardown) {
+  // Destroying a long chain doesn't recurse through every node, with or
+  // without back propagating through it first.
+  for (bool retain_graph : {true, false}) {
+    auto x = Value(1);
+    auto loss = x;
+    for (int i = 0; i < 500'000; ++i) {
+      loss = loss.Add(x);
+    }
+    loss.Backward(retain_graph);
+    EXPECT_FLOAT_EQ(x.gradient(), 500'001);
+  }
+}
+
+TEST(MicrogradValue, ReleaseGraph) {
+  auto model = MLP(2, std::vector<size_t>{8, 1});
+  std::span<const Value> parameters = model.Parameters();
+  auto loss_of = [&] {
+    std::vector<Value> x = {Value(0.5), Value(-1)};
+    return model(x).front().Pow(2);
+  };
+  Value retained = loss_of();
+  retained.Backward();
+  std::vector<float> expected;
+  for (const Value& p : parameters) {
+    expected.push_back(p.gradient());
+    p.gradient(0);
+  }
+  size_t live_nodes = instrumentation::live_nodes();
+  Value released = loss_of();
+  released.Backward(/*retain_graph=*/false);
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    EXPECT_EQ(parameters[i].gradient(), expected[i]);
+  }
+  EXPECT_EQ(released.value(), retained.value());
+  if (instrumentation::kEnabled) {
+    // Only the loss itself is left of the released graph.
+    EXPECT_EQ(instrumentation::live_nodes(), live_nodes + 1);
+  }
+
+  // The parallel backward pass releases the graph the same way, and values
+  // that are still held become leaves.
+  for (const Value& p : parameters) {
+    p.gradient(0);
+  }
+  std::vector<Value> x = {Value(0.5), Value(-1)};
+  Value hidden = model(x).front();
+  Value loss = hidden.Pow(2);
+  ThreadPool pool(3);
+  loss.Backward(pool, /*retain_graph=*/false);
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    EXPECT_FLOAT_EQ(parameters[i].gradient(), expected[i]);
+  }
+  EXPECT_FLOAT_EQ(hidden.gradient(), 2 * hidden.value());
+  // `hidden` no longer reaches the inputs.
+  float x_gradient = x[0].gradient();
+  hidden.Backward();
+  EXPECT_FLOAT_EQ(hidden.gradient(), 1);
+  EXPECT_EQ(x[0].gradient(), x_gradient);
+
+  // Releasing the graph of `y` frees nodes that the cached order of `z`
+  // refers to, so `z` sorts its graph again.
+  for (bool parallel : {false, true}) {
+    auto a = Value(2);
+    Value y = a.Add(a).Multiply(a);
+    Value z = y.Multiply(y);
+    z.Backward();
+    EXPECT_FLOAT_EQ(a.gradient(), 2 * 8 * 8);
+    if (parallel) {
+      z.Backward(pool);
+      a.gradient(2 * 8 * 8);
+    }
+    y.Backward(/*retain_graph=*/false);
+    EXPECT_FLOAT_EQ(a.gradient(), 2 * 8 * 8 + 8);
+    parallel ? z.Backward(pool) : z.Backward();
+    EXPECT_FLOAT_EQ(z.gradient(), 1);
+    // `y` is a leaf now, so it accumulates its gradient.
+    EXPECT_FLOAT_EQ(y.gradient(), 1 + 2 * 8);
+    EXPECT_FLOAT_EQ(a.gradient(), 2 * 8 * 8 + 8);
+  }
+}
+
+TEST(MicrogradValue, DotAndSum) {
+  auto w = std::vector<Value>{Value(2), Value(-3), Value(0.5)};
+  auto x = std::vector<Value>{Value(1), Value(4), Value(-2)};
+  auto dot = Dot(w, x);
+  EXPECT_FLOAT_EQ(dot.value(), -11);
+  auto out = Sum(std::vector<Value>{dot, w[0], dot}).Relu();
+  EXPECT_FLOAT_EQ(out.value(), 0);
+  out = Sum(std::vector<Value>{dot, w[0], dot}).Multiply(-1);
+  out.Backward();
+  EXPECT_FLOAT_EQ(out.value(), 20);
+  EXPECT_FLOAT_EQ(w[0].gradient(), -3);
+  EXPECT_FLOAT_EQ(w[1].gradient(), -8);
+  EXPECT_FLOAT_EQ(x[2].gradient(), -1);
+  // A dot product of a vector with itself.
+  auto y = std::vector<Value>{Value(3), Value(-4)};
+  auto norm = Dot(y, y);
+  norm.Backward();
+  EXPECT_FLOAT_EQ(norm.value(), 25);
+  EXPECT_FLOAT_EQ(y[0].gradient(), 6);
+  EXPECT_FLOAT_EQ(y[1].gradient(), -8);
+}
+
+TEST(MicrogradValue, ParallelBackward) {
+  auto model = MLP(4, std::vector<size_t>{16, 16, 1});
+  std::vector<Value> losses;
+  for (size_t i = 0; i < 100; ++i) {
+    std::vector<Value> x;
+    for (size_t j = 0; j < 4; ++j) {
+      x.push_back(Value(std::sin(i * 4 + j)));
+    }
+    losses.push_back(model(x).front().Subtract(i % 2).Pow(2));
+  }
+  Value loss = Sum(losses).Multiply(0.01).Add(losses.front());
+  std::span<const Value> parameters = model.Parameters();
+  loss.Backward();
+  std::vector<float> expected;
+  for (const Value& p : parameters) {
+    expected.push_back(p.gradient());
+    p.gradient(0);
+  }
+  for (size_t threads : {1, 3, 8}) {
+    ThreadPool pool(threads);
+    loss.Backward(pool);
+    // Leaves accumulate across passes, like the serial path.
+    loss.Backward(pool);
+    for (size_t i = 0; i < parameters.size(); ++i) {
+      // The partial gradients are summed in a different order.
+      EXPECT_NEAR(parameters[i].gradient(), 2 * expected[i],
+                  1e-5 * std::max(1.0f, std::abs(expected[i])));
+      parameters[i].gradient(0);
+    }
+    EXPECT_FLOAT_EQ(loss.gradient(), 1);
+  }
+  // The serial path still works after a parallel one.
+  loss.Backward();
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    EXPECT_FLOAT_EQ(parameters[i].gradient(), expected[i]);
+  }
+}
+
+TEST(MicrogradValue, Double) {
+  // The same expression as `AllOps`, which matches a double precision
+  // reference to the last few bits.
+  double value;
+  double a_gradient;
+  double b_gradient;
+  {
+    using DoubleValue = BasicValue<double>;
+    auto a = DoubleValue(-4);
+    auto b = DoubleValue(2);
+    auto c = a.Add(b);
+    auto d = a.Multiply(b).Add(b.Pow(3));
+    c = c.Add(c).Add(1);
+    c = c.Add(DoubleValue(1).Add(c).Add(a.Negate()));
+    d = d.Add(d.Multiply(2).Add(b.Add(a).Relu()));
+    d = d.Add(DoubleValue(3).Multiply(d).Add(b.Subtract(a).Relu()));
+    auto e = c.Subtract(d);
+    auto f = e.Pow(2.0);
+    auto g = f.Divide(2.0);
+    g = g.Add(DoubleValue(10.0).Divide(f));
+    g.Backward();
+    value = g.value();
+    a_gradient = a.gradient();
+    b_gradient = b.gradient();
+    EXPECT_DOUBLE_EQ(value, 24.70408163265306);
+    EXPECT_DOUBLE_EQ(a_gradient, 138.83381924198252);
+    EXPECT_DOUBLE_EQ(b_gradient, 645.5772594752186);
+  }
+  {
+    auto options = torch::TensorOptions(torch::kDouble).requires_grad(true);
+    auto a = torch::tensor({-4.0}, options);
+    auto b = torch::tensor({2.0}, options);
+    auto c = a + b;
+    auto d = a * b + b.pow(3.0);
+    c = c + c + 1.0;
+    c = c + 1.0 + c + (-a);
+    d = d + d * 2.0 + (b + a).relu();
+    d = d + 3.0 * d + (b - a).relu();
+    auto e = c - d;
+    auto f = e.pow(2.0);
+    auto g = f / 2.0;
+    g = g + 10.0 / f;
+    g.backward();
+    EXPECT_DOUBLE_EQ(g.item().toDouble(), value);
+    EXPECT_DOUBLE_EQ(a.grad().item().toDouble(), a_gradient);
+    EXPECT_DOUBLE_EQ(b.grad().item().toDouble(), b_gradient);
+  }
+}
+
+TEST(MicrogradValue, BFloat16) {
+  static_assert(sizeof(BFloat16) == 2);
+  // 8 bits of precision, rounded to nearest with ties to even.
+  EXPECT_EQ(float(BFloat16(1.0f + 0x1p-9f)), 1.0f);
+  EXPECT_EQ(float(BFloat16(1.0f + 0x1p-8f)), 1.0f);
+  EXPECT_EQ(float(BFloat16(1.0f + 3 * 0x1p-8f)), 1.0f + 0x1p-6f);
+  // The same range as a float.
+  EXPECT_EQ(float(BFloat16(-0x1p100f)), -0x1p100f);
+  EXPECT_TRUE(std::isnan(float(BFloat16(NAN))));
+
+  using HalfValue = BasicValue<BFloat16>;
+  auto w = std::vector<HalfValue>{HalfValue(2), HalfValue(-3), HalfValue(0.5)};
+  auto x = std::vector<HalfValue>{HalfValue(1), HalfValue(4), HalfValue(-2)};
+  auto out = Dot(w, x).Multiply(-1).Add(w[0].Pow(2)).Relu();
+  out.Backward();
+  EXPECT_EQ(float(out.value()), 15);
+  EXPECT_EQ(float(w[0].gradient()), -1 + 4);
+  EXPECT_EQ(float(x[1].gradient()), 3);
+  // Values are rounded when they are stored.
+  EXPECT_EQ(float(HalfValue(1).Add(0x1p-9f).value()), 1);
+}
+
+TEST(MicrogradTape, AllOps) {
+  Tape tape;
+  Tape::Scope scope(&tape);
+  auto a = Value(-4);
+  auto b = Value(2);
+  auto c = a.Add(b);
+  auto d = a.Multiply(b).Add(b.Pow(3));
+  c = c.Add(c).Add(1);
+  c = c.Add(Value(1).Add(c).Add(a.Negate()));
+  d = d.Add(d.Multiply(2).Add(b.Add(a).Relu()));
+  d = d.Add(Value(3).Multiply(d).Add(b.Subtract(a).Relu()));
+  auto e = c.Subtract(d);
+  auto f = e.Pow(2.0);
+  auto g = f.Divide(2.0);
+  g = g.Add(Value(10.0).Divide(f));
+  g.Backward();
+  EXPECT_FLOAT_EQ(g.value(), 24.704082);
+  EXPECT_FLOAT_EQ(a.gradient(), 138.83382);
+  EXPECT_FLOAT_EQ(b.gradient(), 645.5773);
+  // Subtracting, dividing and negating don't go through other operations,
+  // and constant operands are stored in the node that uses them.
+  EXPECT_EQ(tape.size(), 30);
+}
+
+TEST(MicrogradTape, HeapLeaves) {
+  // Values created outside of the tape, like the parameters of a model.
+  auto w = Value(-3);
+  auto b = Value(1);
+  Tape tape;
+  for (int step = 0; step < 2; ++step) {
+    tape.Reset();
+    Tape::Scope scope(&tape);
+    auto x = Value(2);
+    auto out = w.Multiply(x).Add(w.Multiply(b)).Add(b);
+    EXPECT_EQ(tape.size(), 7);
+    EXPECT_FLOAT_EQ(out.value(), -8);
+    out.Backward();
+    EXPECT_FLOAT_EQ(x.gradient(), -3);
+  }
+  // Gradients accumulate into the heap values across backward passes.
+  EXPECT_FLOAT_EQ(w.gradient(), 6);
+  EXPECT_FLOAT_EQ(b.gradient(), -4);
+}
+
+TEST(MicrogradTape, DotAndSum) {
+  // Weights outside of the tape, and inputs inside of it.
+  auto w = std::vector<Value>{Value(2), Value(-3), Value(0.5)};
+  Tape tape;
+  Tape::Scope scope(&tape);
+  auto x = std::vector<Value>{Value(1), Value(4), Value(-2)};
+  auto hidden = std::vector<Value>{Dot(w, x).Relu(), Dot(x, w).Multiply(-1)};
+  auto out = Sum(hidden).Add(Dot(hidden, std::span(x).first(2)));
+  out.Backward();
+  EXPECT_FLOAT_EQ(out.value(), 11 + 44);
+  // Only the second hidden value is positive, and d(out)/d(hidden[1]) is
+  // 1 + x[1].
+  EXPECT_FLOAT_EQ(x[0].gradient(), 5 * -2);
+  EXPECT_FLOAT_EQ(x[1].gradient(), 11 + 5 * 3);
+  EXPECT_FLOAT_EQ(w[0].gradient(), 5 * -1);
+  EXPECT_FLOAT_EQ(w[2].gradient(), 5 * 2);
+}
+
 }  // namespace micrograd
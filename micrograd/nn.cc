@@ -1,8 +1,10 @@
 #include "micrograd/nn.h"
 
 #include <algorithm>
-#include <iterator>
 #include <random>
+#include <stdexcept>
+
+#include "micrograd/instrumentation.h"
 
 namespace micrograd {
 
@@ -19,42 +21,77 @@ float random_float(float start, float end) {
 
 }  // namespace
 
-Neuron::Neuron(size_t number_of_inputs, bool nonlinear)
-    : bias_(random_float(-1, 1)), nonlinear_(nonlinear) {
-  weights_.reserve(number_of_inputs);
-  std::generate_n(std::back_inserter(weights_), number_of_inputs,
-                  [] { return Value(random_float(-1, 1)); });
+template <Scalar T>
+BasicNeuron<T>::BasicNeuron(size_t number_of_inputs, bool nonlinear)
+    : BasicNeuron(BasicParameterBuffer<T>(number_of_inputs + 1), nonlinear) {}
+
+template <Scalar T>
+BasicNeuron<T>::BasicNeuron(BasicParameterBuffer<T> parameters, bool nonlinear)
+    : parameters_(std::move(parameters)), nonlinear_(nonlinear) {
+  // The bias is initialized before the weights.
+  std::span<T> values = parameters_.values();
+  values.back() = random_float(-1, 1);
+  std::generate(values.begin(), values.end() - 1,
+                [] { return random_float(-1, 1); });
 }
 
-Value Neuron::operator()(std::span<const Value> x) const {
-  Value v = bias_;
-  for (size_t i = 0; i < x.size(); ++i) {
-    v = v.Add(weights_[i].Multiply(x[i]));
-  }
+template <Scalar T>
+BasicValue<T> BasicNeuron<T>::operator()(
+    std::span<const BasicValue<T>> x) const {
+  std::span<const BasicValue<T>> p = Parameters();
+  BasicValue<T> v = Dot(p.first(p.size() - 1), x).Add(p.back());
   if (nonlinear_) {
     return v.Relu();
   }
   return v;
 }
 
-std::vector<Value> Neuron::Parameters() const {
-  std::vector<Value> p;
-  p.reserve(weights_.size() + 1);
-  std::copy(weights_.begin(), weights_.end(), std::back_inserter(p));
-  p.push_back(bias_);
-  return p;
+template <Scalar T>
+T BasicNeuron<T>::Evaluate(std::span<const T> x) const {
+  std::span<const T> values = parameters_.values();
+  if (x.size() + 1 != values.size()) {
+    throw std::invalid_argument("wrong number of inputs for neuron");
+  }
+  // The weights are contiguous, so this is exactly what the `Dot` node
+  // computes.
+  T v = scalar::Dot(values.data(), x.data(), x.size()) + values.back();
+  if (nonlinear_) {
+    return v < 0 ? T(0) : v;
+  }
+  return v;
+}
+
+template <Scalar T>
+std::span<const BasicValue<T>> BasicNeuron<T>::Parameters() const {
+  return parameters_.parameters();
 }
 
-Layer::Layer(size_t number_of_inputs, size_t number_of_outputs,
-             bool nonlinear) {
+template <Scalar T>
+BasicLayer<T>::BasicLayer(size_t number_of_inputs, size_t number_of_outputs,
+                          bool nonlinear)
+    : BasicLayer(
+          BasicParameterBuffer<T>((number_of_inputs + 1) * number_of_outputs),
+          number_of_inputs, number_of_outputs, nonlinear) {}
+
+template <Scalar T>
+BasicLayer<T>::BasicLayer(BasicParameterBuffer<T> parameters,
+                          size_t number_of_inputs, size_t number_of_outputs,
+                          bool nonlinear)
+    : parameters_(std::move(parameters)),
+      number_of_inputs_(number_of_inputs),
+      nonlinear_(nonlinear) {
   neurons_.reserve(number_of_outputs);
   for (size_t i = 0; i < number_of_outputs; ++i) {
-    neurons_.emplace_back(number_of_inputs, nonlinear);
+    neurons_.push_back(BasicNeuron<T>(
+        parameters_.Slice(i * (number_of_inputs + 1), number_of_inputs + 1),
+        nonlinear));
   }
 }
 
-std::vector<Value> Layer::operator()(std::span<const Value> x) const {
-  std::vector<Value> outs;
+template <Scalar T>
+std::vector<BasicValue<T>> BasicLayer<T>::operator()(
+    std::span<const BasicValue<T>> x) const {
+  std::vector<BasicValue<T>> outs;
   outs.reserve(neurons_.size());
   for (const auto& n : neurons_) {
     outs.push_back(n(x));
@@ -62,30 +99,73 @@ std::vector<Value> Layer::operator()(std::span<const Value> x) const {
   return outs;
 }
 
-std::vector<Value> Layer::Parameters() const {
-  std::vector<Value> output;
+template <Scalar T>
+Tensor BasicLayer<T>::operator()(const Tensor& x) const
+  requires std::is_same_v<T, float>
+{
+  std::vector<Value> weights;
+  std::vector<Value> biases;
+  weights.reserve(neurons_.size() * number_of_inputs_);
+  biases.reserve(neurons_.size());
   for (const auto& n : neurons_) {
-    for (const auto& p : n.Parameters()) {
-      output.push_back(p);
-    }
+    std::span<const Value> p = n.Parameters();
+    weights.insert(weights.end(), p.begin(), p.end() - 1);
+    biases.push_back(p.back());
+  }
+  Tensor w = Tensor::FromValues(weights, neurons_.size(), x.cols());
+  Tensor b = Tensor::FromValues(biases, 1, neurons_.size());
+  Tensor out = x.MatmulTransposed(w).AddBias(b);
+  if (nonlinear_) {
+    return out.Relu();
+  }
+  return out;
+}
+
+template <Scalar T>
+void BasicLayer<T>::Evaluate(std::span<const T> x, std::span<T> out) const {
+  for (size_t i = 0; i < neurons_.size(); ++i) {
+    out[i] = neurons_[i].Evaluate(x);
   }
-  return output;
 }
 
-MLP::MLP(size_t number_of_inputs, std::span<size_t> number_of_outputs) {
+template <Scalar T>
+std::span<const BasicValue<T>> BasicLayer<T>::Parameters() const {
+  return parameters_.parameters();
+}
+
+template <Scalar T>
+BasicMLP<T>::BasicMLP(size_t number_of_inputs,
+                      std::span<size_t> number_of_outputs)
+    : parameters_([&] {
+        size_t size = 0;
+        size_t prev = number_of_inputs;
+        for (size_t output_size : number_of_outputs) {
+          size += (prev + 1) * output_size;
+          prev = output_size;
+        }
+        return BasicParameterBuffer<T>(size);
+      }()),
+      number_of_inputs_(number_of_inputs) {
   layers_.reserve(number_of_outputs.size() + 1);
   size_t prev = number_of_inputs;
+  size_t offset = 0;
   for (size_t i = 0; size_t output_size : number_of_outputs) {
     bool nonlinear = ++i != number_of_outputs.size();
-    layers_.emplace_back(prev, output_size, nonlinear);
+    size_t size = (prev + 1) * output_size;
+    layers_.push_back(BasicLayer<T>(parameters_.Slice(offset, size), prev,
+                                    output_size, nonlinear));
+    offset += size;
     prev = output_size;
   }
 }
 
-std::vector<Value> MLP::operator()(std::span<const Value> x) const {
+template <Scalar T>
+std::vector<BasicValue<T>> BasicMLP<T>::operator()(
+    std::span<const BasicValue<T>> x) const {
+  MICROGRAD_TRACE_SCOPE("MLP");
   // Hold the memory in the current evaluation pass here,
   // to make sure x always points to valid memory.
-  std::vector<Value> current;
+  std::vector<BasicValue<T>> current;
   for (const auto& layer : layers_) {
     current = layer(x);
     x = current;
@@ -93,13 +173,54 @@ std::vector<Value> MLP::operator()(std::span<const Value> x) const {
   return current;
 }
 
-std::vector<Value> MLP::Parameters() const {
-  std::vector<Value> outputs;
+template <Scalar T>
+Tensor BasicMLP<T>::operator()(const Tensor& x) const
+  requires std::is_same_v<T, float>
+{
+  MICROGRAD_TRACE_SCOPE("MLP");
+  Tensor current = x;
   for (const auto& layer : layers_) {
-    for (const auto& p : layer.Parameters()) {
-      outputs.push_back(p);
-    }
+    current = layer(current);
+  }
+  return current;
+}
+
+template <Scalar T>
+std::vector<T> BasicMLP<T>::Evaluate(std::span<const T> x) const {
+  // Ping-pong between two buffers for the activations of each layer.
+  thread_local std::vector<T> buffers[2];
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    std::vector<T>& out = buffers[i % 2];
+    out.resize(layers_[i].number_of_outputs());
+    layers_[i].Evaluate(x, out);
+    x = out;
+  }
+  return std::vector<T>(x.begin(), x.end());
+}
+
+template <Scalar T>
+std::span<const BasicValue<T>> BasicMLP<T>::Parameters() const {
+  return parameters_.parameters();
+}
+
+template <Scalar T>
+std::vector<size_t> BasicMLP<T>::number_of_outputs() const {
+  std::vector<size_t> outputs;
+  outputs.reserve(layers_.size());
+  for (const BasicLayer<T>& layer : layers_) {
+    outputs.push_back(layer.number_of_outputs());
   }
   return outputs;
 }
+
+template class BasicNeuron<float>;
+template class BasicNeuron<double>;
+template class BasicNeuron<BFloat16>;
+template class BasicLayer<float>;
+template class BasicLayer<double>;
+template class BasicLayer<BFloat16>;
+template class BasicMLP<float>;
+template class BasicMLP<double>;
+template class BasicMLP<BFloat16>;
+
 }  // namespace micrograd
@@ -1,71 +1,162 @@
 #pragma once
 
 #include <span>
+#include <type_traits>
 #include <vector>
 
 #include "micrograd/micrograd.h"
+#include "micrograd/parameter_buffer.h"
+#include "micrograd/tensor.h"
 
 namespace micrograd {
 
-// An mathmatical model of a individual neuron.
-class Neuron {
+// An mathmatical model of a individual neuron, whose weights are scalars of
+// type `T`.
+template <Scalar T>
+class BasicNeuron {
  public:
   //
-  explicit Neuron(size_t number_of_inputs, bool nonlinear = true);
+  explicit BasicNeuron(size_t number_of_inputs, bool nonlinear = true);
 
   // Compute the forward pass of this neuron using x as the input.
   //
   // It's length must match `number_of_inputs` from the constructor.
-  Value operator()(std::span<const Value> x) const;
+  BasicValue<T> operator()(std::span<const BasicValue<T>> x) const;
 
-  // All the weights of this neuron.
-  std::vector<Value> Parameters() const;
+  // Compute the output of this neuron from the current values of its weights,
+  // without building a graph.
+  //
+  // The result is identical to the value of `operator()`.
+  T Evaluate(std::span<const T> x) const;
+
+  // All the weights of this neuron, followed by its bias.
+  std::span<const BasicValue<T>> Parameters() const;
 
  private:
-  std::vector<Value> weights_;
-  Value bias_;
+  template <Scalar>
+  friend class BasicLayer;
+
+  // A neuron that initializes and uses `parameters` as its weights followed
+  // by its bias.
+  BasicNeuron(BasicParameterBuffer<T> parameters, bool nonlinear);
+
+  BasicParameterBuffer<T> parameters_;
   bool nonlinear_;
 };
 
 // A layer of identical neurons in a neural network.
-class Layer {
+template <Scalar T>
+class BasicLayer {
  public:
   // The size of this layer, interms of inputs and outputs.
-  Layer(size_t number_of_inputs, size_t number_of_outputs,
-        bool nonlinear = true);
+  BasicLayer(size_t number_of_inputs, size_t number_of_outputs,
+             bool nonlinear = true);
 
   // Compute the forward pass of this neuron using x as the input.
   //
   // It's length must match `number_of_inputs` from the constructor.
   // The output vector will be of size `number_of_outputs`.
-  std::vector<Value> operator()(std::span<const Value> x) const;
+  std::vector<BasicValue<T>> operator()(std::span<const BasicValue<T>> x) const;
+
+  // Compute the forward pass of a whole batch at once.
+  //
+  // `x` must be a [batch x number_of_inputs] tensor, and the output is a
+  // [batch x number_of_outputs] tensor. Tensors are always floats.
+  Tensor operator()(const Tensor& x) const
+      requires std::is_same_v<T, float>;
+
+  // Compute the outputs of this layer into `out` without building a graph.
+  //
+  // `out` must be of size `number_of_outputs`.
+  void Evaluate(std::span<const T> x, std::span<T> out) const;
+
+  size_t number_of_inputs() const { return number_of_inputs_; }
+  size_t number_of_outputs() const { return neurons_.size(); }
 
   // All the weights for all the neurons in this layer.
-  std::vector<Value> Parameters() const;
+  //
+  // These are contiguous in memory, as a row-major [number_of_outputs x
+  // (number_of_inputs + 1)] matrix where each row is the weights of a neuron
+  // followed by its bias.
+  std::span<const BasicValue<T>> Parameters() const;
 
  private:
-  std::vector<Neuron> neurons_;
+  template <Scalar>
+  friend class BasicMLP;
+
+  // A layer that initializes and uses `parameters` for its neurons.
+  BasicLayer(BasicParameterBuffer<T> parameters, size_t number_of_inputs,
+             size_t number_of_outputs, bool nonlinear);
+
+  BasicParameterBuffer<T> parameters_;
+  std::vector<BasicNeuron<T>> neurons_;
+  size_t number_of_inputs_;
+  bool nonlinear_;
 };
 
 // A multi-layer precepticon.
-class MLP {
+template <Scalar T>
+class BasicMLP {
  public:
   // Create the MLP with the inputs and number of outputs at each layer.
-  MLP(size_t number_of_inputs, std::span<size_t> number_of_outputs);
-  MLP(size_t number_of_inputs, std::vector<size_t> number_of_outputs)
-      : MLP(number_of_inputs, std::span(number_of_outputs)) {}
+  BasicMLP(size_t number_of_inputs, std::span<size_t> number_of_outputs);
+  BasicMLP(size_t number_of_inputs, std::vector<size_t> number_of_outputs)
+      : BasicMLP(number_of_inputs, std::span(number_of_outputs)) {}
 
   // Compute the forward pass of this neuron using x as the input.
   //
   // It's length must match `number_of_inputs` from the constructor.
   // The output vector will be of size last element in `number_of_outputs`.
-  std::vector<Value> operator()(std::span<const Value> x) const;
+  std::vector<BasicValue<T>> operator()(std::span<const BasicValue<T>> x) const;
+
+  // Compute the forward pass of a whole batch at once.
+  //
+  // `x` must be a [batch x number_of_inputs] tensor, and the output is a
+  // [batch x last element in `number_of_outputs`] tensor. Tensors are always
+  // floats.
+  Tensor operator()(const Tensor& x) const
+      requires std::is_same_v<T, float>;
+
+  // Compute the outputs of this MLP from the current values of its
+  // parameters, without building a graph. This is for inference only, as
+  // nothing can be back propigated.
+  //
+  // The result is identical to the values returned by `operator()`.
+  std::vector<T> Evaluate(std::span<const T> x) const;
 
   // all the weights for all layers in this MLP.
-  std::vector<Value> Parameters() const;
+  //
+  // These are contiguous in memory, the parameters of each layer one after
+  // the other.
+  std::span<const BasicValue<T>> Parameters() const;
+
+  // The values of `Parameters()` as a flat array, which can be read or
+  // written directly (for example to save or restore the model).
+  std::span<T> ParameterValues() const { return parameters_.values(); }
+
+  // The shape passed to the constructor.
+  size_t number_of_inputs() const { return number_of_inputs_; }
+  std::vector<size_t> number_of_outputs() const;
 
  private:
-  std::vector<Layer> layers_;
+  BasicParameterBuffer<T> parameters_;
+  size_t number_of_inputs_;
+  std::vector<BasicLayer<T>> layers_;
 };
 
+// The neural network types over floats, which is what every engine supports.
+using Neuron = BasicNeuron<float>;
+using Layer = BasicLayer<float>;
+using MLP = BasicMLP<float>;
+
+extern template class BasicNeuron<float>;
+extern template class BasicNeuron<double>;
+extern template class BasicNeuron<BFloat16>;
+extern template class BasicLayer<float>;
+extern template class BasicLayer<double>;
+extern template class BasicLayer<BFloat16>;
+extern template class BasicMLP<float>;
+extern template class BasicMLP<double>;
+extern template class BasicMLP<BFloat16>;
+
 }  // namespace micrograd
@@ -1,12 +1,71 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
 #include <plot/plot.hpp>
+#include <span>
 #include <stdexcept>
 
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "micrograd/allocation_counter.h"
+#include "micrograd/checkpoint.h"
+#include "micrograd/data_parallel.h"
+#include "micrograd/dataset.h"
+#include "micrograd/instrumentation.h"
 #include "micrograd/micrograd.h"
 #include "micrograd/nn.h"
+#include "micrograd/optimizer.h"
+#include "micrograd/program.h"
+#include "micrograd/tape.h"
+#include "micrograd/tensor.h"
+#include "micrograd/thread_pool.h"
+
+ABSL_FLAG(std::string, engine, "graph",
+          "how to build the graph for each training step: 'graph' allocates "
+          "every node on the heap, 'tape' records them on a micrograd::Tape, "
+          "'program' replays a micrograd::Program traced once up front, "
+          "'parallel' splits the dataset across --threads tapes and 'tensor' "
+          "uses a micrograd::Tensor for the whole batch");
+ABSL_FLAG(std::string, optimizer, "sgd",
+          "how to update the parameters: 'sgd', 'momentum' or 'adam'");
+ABSL_FLAG(size_t, threads, 1,
+          "the number of threads for the parallel engine, and for the "
+          "backward pass of the graph engine");
+ABSL_FLAG(std::string, dataset, "demo_input.json",
+          "the dataset to train on, either as JSON or (for any other "
+          "extension) in the binary format written by dataset_converter");
+ABSL_FLAG(size_t, points, 0,
+          "train on this many randomly generated moons points instead of "
+          "--dataset");
+ABSL_FLAG(size_t, batch_size, 0,
+          "train each step on a random batch of this many points instead of "
+          "the whole dataset");
+ABSL_FLAG(std::string, trace, "",
+          "write a Chrome trace of the training steps to this file (requires "
+          "building with --config=instrument)");
+ABSL_FLAG(std::string, checkpoint, "",
+          "save the model to this file every --checkpoint_every steps (in the "
+          "background) and at the end of training");
+ABSL_FLAG(size_t, checkpoint_every, 10,
+          "the number of steps between checkpoints");
+ABSL_FLAG(std::string, load, "",
+          "load the model from a checkpoint and draw it, instead of training");
+ABSL_FLAG(size_t, draw_every, 0,
+          "also draw the decision boundary every this many steps, as a live "
+          "view of training (0 only draws it at the end). It is drawn against "
+          "the whole dataset, or a fixed sample of it when training on "
+          "batches of a binary dataset");
+
+// The weight of the L2 regularization in the loss.
+constexpr float kAlpha = 1e-4;
 
 struct Dataset {
   std::vector<std::pair<float, float>> points;
@@ -47,16 +106,147 @@ struct Dataset {
     }
     return ds;
   }
+
+  // The examples of a binary dataset at `indices`, or all of them.
+  static Dataset FromMapped(
+      const micrograd::MappedDataset& mapped,
+      std::optional<std::span<const uint32_t>> indices = std::nullopt) {
+    if (mapped.dimensions() != 2) {
+      throw std::runtime_error("expected points with 2 dimensions");
+    }
+    size_t n = indices ? indices->size() : mapped.size();
+    Dataset ds;
+    ds.points.reserve(n);
+    ds.classifications.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      size_t j = indices ? (*indices)[i] : i;
+      std::span<const float> point = mapped.features(j);
+      ds.points.emplace_back(point[0], point[1]);
+      ds.classifications.push_back(mapped.labels()[j]);
+    }
+    return ds;
+  }
+
+  // The examples at `indices`.
+  Dataset Batch(std::span<const uint32_t> indices) const {
+    Dataset ds;
+    ds.points.reserve(indices.size());
+    ds.classifications.reserve(indices.size());
+    for (uint32_t i : indices) {
+      ds.points.push_back(points[i]);
+      ds.classifications.push_back(classifications[i]);
+    }
+    return ds;
+  }
+
+  // The points followed by their classifications, as the inputs of a
+  // program.
+  std::vector<float> Inputs() const {
+    std::vector<float> inputs;
+    inputs.reserve(3 * points.size());
+    for (const auto& [x, y] : points) {
+      inputs.push_back(x);
+      inputs.push_back(y);
+    }
+    inputs.insert(inputs.end(), classifications.begin(),
+                  classifications.end());
+    return inputs;
+  }
+
+  // Two interleaving half circles, like `sklearn.datasets.make_moons`.
+  static Dataset MakeMoons(size_t n, float noise) {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> jitter(0.0, noise);
+    Dataset ds;
+    ds.points.reserve(n);
+    ds.classifications.reserve(n);
+    size_t outer = n / 2;
+    for (size_t i = 0; i < n; ++i) {
+      bool is_outer = i < outer;
+      size_t count = is_outer ? outer : n - outer;
+      size_t j = is_outer ? i : i - outer;
+      float t = count > 1 ? M_PI * j / (count - 1) : 0;
+      float x = is_outer ? std::cos(t) : 1 - std::cos(t);
+      float y = is_outer ? std::sin(t) : 0.5 - std::sin(t);
+      ds.points.emplace_back(x + jitter(rng), y + jitter(rng));
+      ds.classifications.push_back(is_outer ? -1 : 1);
+    }
+    return ds;
+  }
 };
 
-float EvaluatePoint(micrograd::MLP& model, plot::Pointf p) {
-  using micrograd::Value;
-  std::vector<Value> inputs = {Value(p.x), Value(-p.y)};
-  Value score = model(inputs).front();
-  return score.value();
+float EvaluatePoint(const micrograd::MLP& model, plot::Pointf p) {
+  std::array<float, 2> inputs = {p.x, -p.y};
+  return model.Evaluate(inputs).front();
 }
 
-void Draw(const Dataset& ds, micrograd::MLP& model) {
+// The output of a model at every point of a grid spanning the bounds of a
+// canvas, so filling the canvas only looks the outputs up instead of running
+// the model for each fill.
+class DecisionGrid {
+ public:
+  // A grid of `columns` x `rows` points, including the corners of `bounds`.
+  DecisionGrid(plot::Rectf bounds, size_t columns, size_t rows)
+      : bounds_(bounds),
+        columns_(columns),
+        rows_(rows),
+        outputs_(columns * rows) {}
+
+  // Evaluate `model` at every point of the grid. The grid is split into
+  // square tiles, which are evaluated concurrently on `pool`.
+  void Evaluate(const micrograd::MLP& model, micrograd::ThreadPool& pool) {
+    constexpr size_t kTileSize = 16;
+    size_t tile_columns = (columns_ + kTileSize - 1) / kTileSize;
+    size_t tile_rows = (rows_ + kTileSize - 1) / kTileSize;
+    pool.ParallelFor(tile_columns * tile_rows, [&](size_t tile) {
+      size_t column_begin = tile % tile_columns * kTileSize;
+      size_t row_begin = tile / tile_columns * kTileSize;
+      for (size_t row = row_begin;
+           row < std::min(row_begin + kTileSize, rows_); ++row) {
+        for (size_t column = column_begin;
+             column < std::min(column_begin + kTileSize, columns_);
+             ++column) {
+          outputs_[row * columns_ + column] =
+              EvaluatePoint(model, Point(column, row));
+        }
+      }
+    });
+  }
+
+  // The output at the point of the grid nearest to `p`.
+  float operator()(plot::Pointf p) const {
+    size_t column = Nearest(p.x, bounds_.p1.x, bounds_.p2.x, columns_);
+    size_t row = Nearest(p.y, bounds_.p1.y, bounds_.p2.y, rows_);
+    return outputs_[row * columns_ + column];
+  }
+
+ private:
+  plot::Pointf Point(size_t column, size_t row) const {
+    return plot::Pointf(
+        Coordinate(column, bounds_.p1.x, bounds_.p2.x, columns_),
+        Coordinate(row, bounds_.p1.y, bounds_.p2.y, rows_));
+  }
+
+  static float Coordinate(size_t i, float begin, float end, size_t n) {
+    return n > 1 ? begin + (end - begin) * i / (n - 1) : begin;
+  }
+
+  static size_t Nearest(float x, float begin, float end, size_t n) {
+    if (n < 2 || end == begin) {
+      return 0;
+    }
+    float i = std::round((x - begin) / (end - begin) * (n - 1));
+    return std::clamp<float>(i, 0, n - 1);
+  }
+
+  plot::Rectf bounds_;
+  size_t columns_;
+  size_t rows_;
+  std::vector<float> outputs_;
+};
+
+void Draw(const Dataset& ds, const micrograd::MLP& model,
+          micrograd::ThreadPool& pool) {
   using namespace plot;
   TerminalInfo term;
   term.detect();
@@ -82,78 +272,340 @@ void Draw(const Dataset& ds, micrograd::MLP& model) {
   }
   canvas.line(palette::whitesmoke, {-3, 0}, {3, 0}, TerminalOp::ClipSrc);
   canvas.line(palette::whitesmoke, {0, -3}, {0, 3}, TerminalOp::ClipSrc);
+  // Evaluate the model once per point of the canvas, for both fills.
+  DecisionGrid grid(canvas.bounds(), 2 * canvasCellCols, 4 * canvasCellRows);
+  grid.Evaluate(model, pool);
   canvas.fill(
-      palette::pink, canvas.bounds(),
-      [&model](Pointf p) { return EvaluatePoint(model, p) > 0; },
+      palette::pink, canvas.bounds(), [&grid](Pointf p) { return grid(p) > 0; },
       TerminalOp::ClipSrc);
   canvas.fill(
       palette::lightblue, canvas.bounds(),
-      [&model](Pointf p) { return EvaluatePoint(model, p) <= 0; },
-      TerminalOp::ClipSrc);
+      [&grid](Pointf p) { return grid(p) <= 0; }, TerminalOp::ClipSrc);
 
   std::cout << margin(frame(BorderStyle::Double, &canvas, term)) << std::flush;
 }
 
-int main() {
-  auto training_data = Dataset::ParseFile("demo_input.json");
-  using namespace micrograd;
-  // 2 layer neural network
-  auto model = MLP(2, std::vector<size_t>{16, 16, 1});
-  std::cout << "number of parameters: " << model.Parameters().size() << "\n";
+// Build the graph of the SVM "max-margin" loss over a batch of points out of
+// scalar values. Returns the total loss, followed by the score of each point.
+std::vector<micrograd::Value> BuildLoss(
+    std::span<const micrograd::Value> points,
+    std::span<const micrograd::Value> classifications,
+    const micrograd::MLP& model,
+    std::span<const micrograd::Value> parameters) {
+  using micrograd::Value;
+  MICROGRAD_TRACE_SCOPE("BuildLoss");
+  std::vector<Value> outputs;
+  outputs.reserve(classifications.size() + 1);
+  outputs.push_back(Value(0.0));
+  for (size_t i = 0; i < classifications.size(); ++i) {
+    Value score = model(points.subspan(2 * i, 2)).front();
+    outputs.push_back(std::move(score));
+  }
+  Value data_loss =
+      HingeLoss(std::span(outputs).subspan(1), classifications);
+  Value reg_loss = Dot(parameters, parameters).Multiply(kAlpha);
+  outputs.front() = data_loss.Add(reg_loss);
+  return outputs;
+}
 
-  constexpr size_t steps = 100;
-  for (size_t k = 0; k < steps; ++k) {
-    // Forward pass
-    std::vector<Value> scores;
-    scores.reserve(training_data.points.size());
-    for (const auto& [x, y] : training_data.points) {
+// Compute the forward and backward pass of the loss over the dataset,
+// building a graph out of scalar values. This records the score for each
+// point into `scores` and returns the loss.
+float ScalarStep(const Dataset& ds, const micrograd::MLP& model,
+                 std::span<const micrograd::Value> parameters,
+                 micrograd::ThreadPool& pool, std::vector<float>* scores) {
+  using micrograd::Value;
+  // Forward pass
+  std::vector<Value> points;
+  points.reserve(2 * ds.points.size());
+  for (const auto& [x, y] : ds.points) {
+    points.push_back(Value(x));
+    points.push_back(Value(y));
+  }
+  std::vector<Value> classifications;
+  classifications.reserve(ds.classifications.size());
+  for (float classification : ds.classifications) {
+    classifications.push_back(Value(classification));
+  }
+  std::vector<Value> outputs =
+      BuildLoss(points, classifications, model, parameters);
+  for (size_t i = 1; i < outputs.size(); ++i) {
+    scores->push_back(outputs[i].value());
+  }
+  // Backward pass, releasing the graph as it goes since it is rebuilt for
+  // the next step anyway.
+  if (pool.size() > 1) {
+    outputs.front().Backward(pool, /*retain_graph=*/false);
+  } else {
+    outputs.front().Backward(/*retain_graph=*/false);
+  }
+  return outputs.front().value();
+}
+
+// The same as `ScalarStep`, but replaying a program that was traced once
+// instead of building the graph again. `inputs` are the points followed by
+// their classifications.
+float ProgramStep(micrograd::Program& program, std::span<const float> inputs,
+                  std::vector<float>* scores) {
+  // Forward pass
+  program.Forward(inputs);
+  for (size_t i = 1; i < program.number_of_outputs(); ++i) {
+    scores->push_back(program.output(i));
+  }
+  // Backward pass
+  program.Backward();
+  return program.output(0);
+}
+
+// The same as `ScalarStep`, but each thread of `parallel` records the loss
+// of its share of the dataset on its own tape.
+float ParallelStep(const Dataset& ds, const micrograd::MLP& model,
+                   std::span<const micrograd::Value> parameters,
+                   micrograd::DataParallel& parallel,
+                   std::vector<float>* scores) {
+  using micrograd::Value;
+  size_t n = ds.points.size();
+  scores->resize(n);
+  // Forward and backward pass of the data loss
+  float data_loss = parallel.Backward(n, [&](size_t begin, size_t end) {
+    if (begin == end) {
+      return Value(0);
+    }
+    std::vector<Value> shard_scores;
+    std::vector<Value> expected;
+    shard_scores.reserve(end - begin);
+    expected.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      const auto& [x, y] = ds.points[i];
       std::vector<Value> inputs = {Value(x), Value(y)};
       Value score = model(inputs).front();
-      scores.push_back(std::move(score));
+      (*scores)[i] = score.value();
+      shard_scores.push_back(score);
+      expected.push_back(Value(ds.classifications[i]));
     }
-    // SVM "max-margin" loss
-    std::vector<Value> losses;
-    losses.reserve(scores.size());
-    for (size_t i = 0; i < scores.size(); ++i) {
-      auto expected = Value(training_data.classifications[i]);
-      Value loss = Value(1).Add(expected.Negate().Multiply(scores[i])).Relu();
-      losses.push_back(loss);
+    // The mean over the shard, weighted by its share of the dataset.
+    return HingeLoss(shard_scores, expected)
+        .Multiply(static_cast<float>(end - begin) / n);
+  });
+  // Forward and backward pass of the regularization loss
+  Value reg_loss = Dot(parameters, parameters).Multiply(kAlpha);
+  reg_loss.Backward(/*retain_graph=*/false);
+  return data_loss + reg_loss.value();
+}
+
+// The same as `ScalarStep`, but using a single tensor for the whole batch.
+float TensorStep(const micrograd::Tensor& points,
+                 const micrograd::Tensor& classifications,
+                 const micrograd::MLP& model,
+                 std::span<const micrograd::Value> parameters,
+                 std::vector<float>* scores) {
+  using micrograd::Tensor;
+  // Forward pass
+  Tensor outputs = model(points);
+  // SVM "max-margin" loss
+  Tensor data_loss =
+      classifications.Multiply(outputs).Multiply(-1).Add(1).Relu().Mean();
+  Tensor p = Tensor::FromValues(parameters, 1, parameters.size());
+  Tensor reg_loss = p.Multiply(p).Sum().Multiply(kAlpha);
+  Tensor total_loss = data_loss.Add(reg_loss);
+
+  scores->assign(outputs.values().begin(), outputs.values().end());
+  // Backward pass
+  total_loss.Backward();
+  return total_loss.value(0, 0);
+}
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  using namespace micrograd;
+  size_t points = absl::GetFlag(FLAGS_points);
+  std::filesystem::path path = absl::GetFlag(FLAGS_dataset);
+  size_t batch_size = absl::GetFlag(FLAGS_batch_size);
+  // A binary dataset stays mapped, and is only copied into memory when
+  // training on all of it.
+  std::optional<MappedDataset> mapped;
+  Dataset training_data;
+  if (points != 0) {
+    training_data = Dataset::MakeMoons(points, /*noise=*/0.1);
+  } else if (path.extension() == ".json") {
+    training_data = Dataset::ParseFile(path);
+  } else {
+    mapped.emplace(path);
+    if (batch_size == 0) {
+      training_data = Dataset::FromMapped(*mapped);
     }
-    Value data_loss = Value(0.0);
-    for (const auto& loss : losses) {
-      data_loss = loss.Add(data_loss);
+  }
+  std::optional<MiniBatches> batches;
+  if (batch_size != 0) {
+    size_t size = mapped ? mapped->size() : training_data.points.size();
+    batches.emplace(size, batch_size, /*seed=*/1337);
+  }
+  std::string engine = absl::GetFlag(FLAGS_engine);
+  if (engine != "graph" && engine != "tape" && engine != "program" &&
+      engine != "parallel" && engine != "tensor") {
+    throw std::runtime_error("unknown engine: " + engine);
+  }
+  // 2 layer neural network, either trained from scratch or loaded from a
+  // checkpoint and only drawn.
+  std::string load = absl::GetFlag(FLAGS_load);
+  auto load_start = std::chrono::steady_clock::now();
+  auto model = load.empty() ? MLP(2, std::vector<size_t>{16, 16, 1})
+                            : LoadCheckpoint(load);
+  if (!load.empty()) {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - load_start;
+    std::cout << "loaded " << load << " in " << elapsed.count() << "ms\n";
+  }
+  std::span<const Value> parameters = model.Parameters();
+  std::cout << "number of parameters: " << parameters.size() << "\n";
+  std::unique_ptr<Optimizer> optimizer;
+  if (absl::GetFlag(FLAGS_optimizer) == "sgd") {
+    optimizer = std::make_unique<SGD>(parameters, /*learning_rate=*/1.0);
+  } else if (absl::GetFlag(FLAGS_optimizer) == "momentum") {
+    optimizer = std::make_unique<SGD>(parameters, /*learning_rate=*/0.3,
+                                      /*momentum=*/0.9);
+  } else if (absl::GetFlag(FLAGS_optimizer) == "adam") {
+    optimizer = std::make_unique<Adam>(parameters, /*learning_rate=*/0.05);
+  } else {
+    throw std::runtime_error("unknown optimizer: " +
+                             absl::GetFlag(FLAGS_optimizer));
+  }
+  float initial_learning_rate = optimizer->learning_rate();
+
+  // The examples of the current step, which are the whole dataset unless
+  // training on batches.
+  Dataset batch;
+  const Dataset* data = &training_data;
+  auto next_batch = [&] {
+    std::span<const uint32_t> indices = batches->Next();
+    batch = mapped ? Dataset::FromMapped(*mapped, indices)
+                   : training_data.Batch(indices);
+    data = &batch;
+  };
+  if (batches) {
+    next_batch();
+  }
+  size_t n = data->points.size();
+
+  // The examples as the inputs of a program, for the program engine, and as
+  // tensors, for the tensor engine.
+  std::vector<float> inputs;
+  Tensor point_tensor(n, 2);
+  Tensor classification_tensor(n, 1);
+  auto load_inputs = [&] {
+    inputs = data->Inputs();
+    point_tensor = Tensor(
+        n, 2, std::vector<float>(inputs.begin(), inputs.begin() + 2 * n));
+    classification_tensor = Tensor(n, 1, data->classifications);
+  };
+  load_inputs();
+  std::optional<Program> program;
+  if (engine == "program") {
+    program.emplace(inputs, [&](std::span<const Value> inputs) {
+      return BuildLoss(inputs.first(2 * n), inputs.subspan(2 * n), model,
+                       parameters);
+    });
+    program->Simplify();
+  }
+
+  size_t threads = std::max<size_t>(absl::GetFlag(FLAGS_threads), 1);
+  std::optional<DataParallel> parallel;
+  if (engine == "parallel") {
+    parallel.emplace(parameters, threads);
+  }
+  ThreadPool pool(engine == "graph" ? threads : 1);
+  // The decision boundary is drawn on all the threads, whatever the engine.
+  ThreadPool draw_pool(threads);
+  // The examples the decision boundary is drawn against, which are the same
+  // at every step: the whole dataset, unless it is a binary dataset that
+  // stays mapped, which is too large to plot, so a fixed sample of it.
+  Dataset draw_sample;
+  const Dataset* draw_data = &training_data;
+  if (mapped && training_data.points.empty()) {
+    constexpr size_t kDrawPoints = 2000;
+    MiniBatches sample(mapped->size(),
+                       std::min(mapped->size(), kDrawPoints), /*seed=*/7);
+    draw_sample = Dataset::FromMapped(*mapped, sample.Next());
+    draw_data = &draw_sample;
+  }
+  size_t draw_every = absl::GetFlag(FLAGS_draw_every);
+
+  std::optional<Checkpointer> checkpointer;
+  if (std::string checkpoint = absl::GetFlag(FLAGS_checkpoint);
+      !checkpoint.empty()) {
+    checkpointer.emplace(checkpoint);
+  }
+  size_t checkpoint_every =
+      std::max<size_t>(absl::GetFlag(FLAGS_checkpoint_every), 1);
+
+  Tape tape;
+  size_t steps = load.empty() ? 100 : 0;
+  for (size_t k = 0; k < steps; ++k) {
+    MICROGRAD_TRACE_SCOPE("Step");
+    auto start = std::chrono::steady_clock::now();
+    size_t allocations_at_start = allocation_counter::allocations();
+    if (batches && k > 0) {
+      next_batch();
+      load_inputs();
     }
-    data_loss = data_loss.Multiply(Value(1).Divide(Value(losses.size())));
-    constexpr float alpha = 1e-4;
-    Value reg_loss = Value(0.0);
-    for (const auto& p : model.Parameters()) {
-      reg_loss = reg_loss.Add(p.Multiply(p));
+    optimizer->ZeroGrad();
+    std::vector<float> scores;
+    scores.reserve(n);
+    float total_loss;
+    if (engine == "tensor") {
+      total_loss = TensorStep(point_tensor, classification_tensor, model,
+                              parameters, &scores);
+    } else if (engine == "program") {
+      total_loss = ProgramStep(*program, inputs, &scores);
+    } else if (engine == "parallel") {
+      total_loss = ParallelStep(*data, model, parameters, *parallel, &scores);
+    } else if (engine == "tape") {
+      tape.Reset();
+      Tape::Scope scope(&tape);
+      total_loss = ScalarStep(*data, model, parameters, pool, &scores);
+    } else {
+      total_loss = ScalarStep(*data, model, parameters, pool, &scores);
     }
-    reg_loss = Value(alpha).Multiply(reg_loss);
-    auto total_loss = data_loss.Add(reg_loss);
 
     // Accuracy
     float accuracy = 0.0;
     for (size_t i = 0; i < scores.size(); ++i) {
-      float score = scores[i].value();
-      float expected = training_data.classifications[i];
+      float score = scores[i];
+      float expected = data->classifications[i];
       accuracy += (score > 0) == (expected > 0) ? 1.0 : 0.0;
     }
     accuracy = accuracy / scores.size();
 
-    // Backward pass
-    for (auto& p : model.Parameters()) {
-      p.gradient(0);
-    }
-    total_loss.Backward();
-
     // Update
-    float learning_rate = 1.0 - ((0.9 * k) / steps);
-    for (auto& p : model.Parameters()) {
-      p.value(p.value() - (learning_rate * p.gradient()));
+    optimizer->learning_rate(initial_learning_rate *
+                             (1.0 - ((0.9 * k) / steps)));
+    optimizer->Step();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "step " << k << " loss " << total_loss << " accuracy "
+              << accuracy * 100 << "% allocations "
+              << allocation_counter::allocations() - allocations_at_start
+              << " time " << elapsed.count() << "ms\n";
+    if (checkpointer && (k + 1) % checkpoint_every == 0) {
+      checkpointer->Save(model);
+    }
+    if (draw_every > 0 && (k + 1) % draw_every == 0 && k + 1 < steps) {
+      Draw(*draw_data, model, draw_pool);
+    }
+  }
+  if (checkpointer) {
+    checkpointer->Save(model);
+    checkpointer->Wait();
+  }
+  if (instrumentation::kEnabled) {
+    std::cout << instrumentation::Summary();
+  }
+  if (std::string trace = absl::GetFlag(FLAGS_trace); !trace.empty()) {
+    if (!instrumentation::kEnabled) {
+      std::cerr << "--trace requires building with --config=instrument\n";
     }
-    std::cout << "step " << k << " loss " << total_loss.value() << " accuracy "
-              << accuracy * 100 << "%\n";
+    std::ofstream out(trace);
+    instrumentation::WriteChromeTrace(out);
   }
-  Draw(training_data, model);
+  Draw(*draw_data, model, draw_pool);
 }
@@ -0,0 +1,128 @@
+#include "micrograd/nn.h"
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <random>
+#include <thread>
+
+namespace micrograd {
+
+namespace {
+
+// Check that `Evaluate` matches the graph of an MLP over `T` exactly, and
+// that the graph back propagates into the parameters.
+template <Scalar T>
+void ExpectEvaluateMatchesGraph() {
+  auto model = BasicMLP<T>(3, std::vector<size_t>{8, 8, 2});
+  std::vector<T> input = {T(0.5f), T(-1.5f), T(2.0f)};
+  std::vector<BasicValue<T>> x(input.begin(), input.end());
+  std::vector<BasicValue<T>> out = model(x);
+  std::vector<T> expected = model.Evaluate(input);
+  ASSERT_EQ(out.size(), expected.size());
+  for (size_t i = 0; i < out.size(); ++i) {
+    EXPECT_EQ(static_cast<double>(out[i].value()),
+              static_cast<double>(expected[i]));
+  }
+  Sum(out).Backward();
+  // The biases of the last layer each get a gradient of one.
+  EXPECT_EQ(static_cast<double>(model.Parameters().back().gradient()), 1);
+}
+
+}  // namespace
+
+TEST(MicrogradMLP, Evaluate) {
+  auto model = MLP(3, std::vector<size_t>{16, 16, 2});
+  std::vector<std::vector<float>> inputs = {
+      {2, 3, -1}, {3, -1, 0.5}, {0.5, 1, 1}, {-0.25, 0.1, 7}};
+  for (const auto& input : inputs) {
+    std::vector<Value> x;
+    for (float f : input) {
+      x.push_back(Value(f));
+    }
+    std::vector<Value> expected = model(x);
+    std::vector<float> actual = model.Evaluate(input);
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+      // Not just close, the exact same float.
+      EXPECT_EQ(actual[i], expected[i].value());
+    }
+  }
+  EXPECT_THROW(model.Evaluate(std::vector<float>{1, 2}), std::invalid_argument);
+}
+
+TEST(MicrogradMLP, ContiguousParameters) {
+  auto model = MLP(3, std::vector<size_t>{4, 2});
+  std::span<const Value> parameters = model.Parameters();
+  ASSERT_EQ(parameters.size(), 4 * 4 + 2 * 5);
+  // The values and gradients are flat arrays.
+  for (size_t i = 1; i < parameters.size(); ++i) {
+    parameters[i].gradient(i);
+  }
+  std::vector<Value> x = {Value(1), Value(2), Value(3)};
+  Value out = model(x)[1];
+  float value = out.value();
+  // Each neuron's weights are followed by its bias, the bias of the second
+  // neuron of the last layer is the last parameter.
+  parameters.back().value(parameters.back().value() + 1);
+  EXPECT_FLOAT_EQ(model(x)[1].value(), value + 1);
+  EXPECT_EQ(model.Parameters().data(), parameters.data());
+}
+
+TEST(MicrogradMLP, ParametersOutliveModel) {
+  std::optional<Value> weight;
+  Value out = Value(0);
+  {
+    auto model = MLP(2, std::vector<size_t>{1});
+    weight = model.Parameters()[0];
+    weight->value(3);
+    // The bias.
+    model.Parameters()[2].value(1);
+    std::vector<Value> x = {Value(2), Value(0)};
+    out = model(x)[0].Multiply(*weight);
+  }
+  // The parameters are still alive, through `weight` and the graph of `out`.
+  EXPECT_FLOAT_EQ(out.value(), 3 * (3 * 2 + 1));
+  out.Backward();
+  EXPECT_EQ(weight->value(), 3);
+  // d(w * (2w + 1))/dw = 4w + 1.
+  EXPECT_FLOAT_EQ(weight->gradient(), 13);
+}
+
+TEST(MicrogradMLP, ScalarTypes) {
+  ExpectEvaluateMatchesGraph<float>();
+  ExpectEvaluateMatchesGraph<double>();
+  ExpectEvaluateMatchesGraph<BFloat16>();
+  EXPECT_EQ(BasicMLP<BFloat16>(3, std::vector<size_t>{4, 2})
+                .ParameterValues()
+                .size_bytes(),
+            MLP(3, std::vector<size_t>{4, 2}).ParameterValues().size_bytes() /
+                2);
+}
+
+TEST(MicrogradMLP, SeededInitialization) {
+  // The random number generator is per thread, so a new thread starts from
+  // the seed.
+  std::vector<float> values;
+  std::thread([&values] {
+    auto model = MLP(2, std::vector<size_t>{3, 1});
+    for (const Value& p : model.Parameters()) {
+      values.push_back(p.value());
+    }
+  }).join();
+  // Each neuron draws its bias, then its weights.
+  std::seed_seq seed{3, 2, 4, 1};
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  std::vector<float> expected;
+  for (size_t inputs : {2, 2, 2, 3}) {
+    float bias = dist(rng);
+    for (size_t i = 0; i < inputs; ++i) {
+      expected.push_back(dist(rng));
+    }
+    expected.push_back(bias);
+  }
+  EXPECT_EQ(values, expected);
+}
+
+}  // namespace micrograd
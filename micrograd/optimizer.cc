@@ -0,0 +1,106 @@
+#include "micrograd/optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "micrograd/kernels.h"
+#include "micrograd/value_impl.h"
+
+namespace micrograd {
+
+Optimizer::Optimizer(std::span<const Value> parameters, float learning_rate)
+    : parameters_(parameters.begin(), parameters.end()),
+      learning_rate_(learning_rate) {
+  bool contiguous = !parameters_.empty();
+  for (size_t i = 0; i < parameters_.size(); ++i) {
+    const Value& p = parameters_[i];
+    if (p.tape_ != nullptr) {
+      throw std::invalid_argument("parameters must not be on a tape");
+    }
+    const ValueImpl<float>& first = *parameters_.front().impl_;
+    if (p.impl_->value_data() != first.value_data() + i ||
+        p.impl_->grad_data() != first.grad_data() + i) {
+      contiguous = false;
+    }
+  }
+  if (contiguous) {
+    contiguous_values_ = parameters_.front().impl_->value_data();
+    contiguous_gradients_ = parameters_.front().impl_->grad_data();
+  } else {
+    values_.resize(parameters_.size());
+    gradients_.resize(parameters_.size());
+  }
+}
+
+void Optimizer::ZeroGrad() {
+  if (contiguous_gradients_ != nullptr) {
+    std::fill_n(contiguous_gradients_, parameters_.size(), 0.0);
+    return;
+  }
+  for (const Value& p : parameters_) {
+    p.gradient(0);
+  }
+}
+
+void Optimizer::Step() {
+  size_t n = parameters_.size();
+  if (contiguous_values_ != nullptr) {
+    Update(std::span(contiguous_values_, n),
+           std::span(contiguous_gradients_, n));
+    return;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    values_[i] = parameters_[i].value();
+    gradients_[i] = parameters_[i].gradient();
+  }
+  Update(values_, gradients_);
+  for (size_t i = 0; i < n; ++i) {
+    parameters_[i].value(values_[i]);
+  }
+}
+
+SGD::SGD(std::span<const Value> parameters, float learning_rate,
+         float momentum)
+    : Optimizer(parameters, learning_rate), momentum_(momentum) {}
+
+void SGD::Update(std::span<float> values, std::span<const float> gradients) {
+  if (momentum_ == 0.0) {
+    kernels::Axpy(-learning_rate(), gradients.data(), values.data(),
+                  values.size());
+    return;
+  }
+  velocity_.resize(values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    velocity_[i] = momentum_ * velocity_[i] + gradients[i];
+  }
+  kernels::Axpy(-learning_rate(), velocity_.data(), values.data(),
+                values.size());
+}
+
+Adam::Adam(std::span<const Value> parameters, float learning_rate,
+           float beta1, float beta2, float epsilon)
+    : Optimizer(parameters, learning_rate),
+      beta1_(beta1),
+      beta2_(beta2),
+      epsilon_(epsilon) {}
+
+void Adam::Update(std::span<float> values, std::span<const float> gradients) {
+  m_.resize(values.size());
+  v_.resize(values.size());
+  beta1_power_ *= beta1_;
+  beta2_power_ *= beta2_;
+  // Fold the bias corrections into the step size and epsilon, so the loop
+  // over the parameters is a handful of multiplies and adds.
+  float step_size = learning_rate() * std::sqrt(1 - beta2_power_) /
+                    (1 - beta1_power_);
+  float epsilon = epsilon_ * std::sqrt(1 - beta2_power_);
+  for (size_t i = 0; i < values.size(); ++i) {
+    float g = gradients[i];
+    m_[i] = beta1_ * m_[i] + (1 - beta1_) * g;
+    v_[i] = beta2_ * v_[i] + (1 - beta2_) * g * g;
+    values[i] -= step_size * m_[i] / (std::sqrt(v_[i]) + epsilon);
+  }
+}
+
+}  // namespace micrograd
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "micrograd/micrograd.h"
+
+namespace micrograd {
+
+/**
+ * Updates a fixed set of parameters from their gradients.
+ *
+ * The parameters are captured once when the optimizer is created. When they
+ * are stored contiguously (such as the parameters of a `MLP`), each step
+ * updates the values in place, otherwise it gathers them into a contiguous
+ * buffer first. Either way the update itself (and any state the optimizer
+ * keeps per parameter) is a simple loop over flat arrays.
+ */
+class Optimizer {
+ public:
+  // The parameters must not be recorded on a tape.
+  Optimizer(std::span<const Value> parameters, float learning_rate);
+  Optimizer(const Optimizer&) = delete;
+  Optimizer& operator=(const Optimizer&) = delete;
+  virtual ~Optimizer() = default;
+
+  // Reset the gradients of all the parameters to zero.
+  void ZeroGrad();
+
+  // Update all the parameters using their current gradients.
+  void Step();
+
+  float learning_rate() const { return learning_rate_; }
+  void learning_rate(float learning_rate) { learning_rate_ = learning_rate; }
+
+ protected:
+  // Update `values` in place from `gradients`, which are the same length and
+  // in the same order as the parameters.
+  virtual void Update(std::span<float> values,
+                      std::span<const float> gradients) = 0;
+
+ private:
+  std::vector<Value> parameters_;
+  // Where the values and gradients of the parameters are stored, if they are
+  // contiguous.
+  float* contiguous_values_ = nullptr;
+  float* contiguous_gradients_ = nullptr;
+  // Buffers for the parameters when they are not contiguous.
+  std::vector<float> values_;
+  std::vector<float> gradients_;
+  float learning_rate_;
+};
+
+// Stochastic gradient descent, with optional momentum.
+class SGD : public Optimizer {
+ public:
+  SGD(std::span<const Value> parameters, float learning_rate,
+      float momentum = 0.0);
+
+ protected:
+  void Update(std::span<float> values,
+              std::span<const float> gradients) override;
+
+ private:
+  float momentum_;
+  std::vector<float> velocity_;
+};
+
+// The Adam optimizer from "Adam: A Method for Stochastic Optimization".
+class Adam : public Optimizer {
+ public:
+  Adam(std::span<const Value> parameters, float learning_rate = 1e-3,
+       float beta1 = 0.9, float beta2 = 0.999, float epsilon = 1e-8);
+
+ protected:
+  void Update(std::span<float> values,
+              std::span<const float> gradients) override;
+
+ private:
+  float beta1_;
+  float beta2_;
+  float epsilon_;
+  // The running products of the betas, for bias correction.
+  float beta1_power_ = 1.0;
+  float beta2_power_ = 1.0;
+  // The first and second moments of the gradients.
+  std::vector<float> m_;
+  std::vector<float> v_;
+};
+
+}  // namespace micrograd
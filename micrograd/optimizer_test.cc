@@ -0,0 +1,119 @@
+#include "micrograd/optimizer.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "micrograd/parameter_buffer.h"
+#include "micrograd/tape.h"
+
+namespace micrograd {
+
+namespace {
+
+// Minimize (x - 3)^2 + (y + 1)^2 and return the final loss.
+float Minimize(Optimizer& optimizer, std::span<const Value> parameters,
+               size_t steps) {
+  float loss = 0;
+  for (size_t i = 0; i < steps; ++i) {
+    optimizer.ZeroGrad();
+    Value l = parameters[0].Subtract(3).Pow(2).Add(
+        parameters[1].Add(1).Pow(2));
+    l.Backward();
+    loss = l.value();
+    optimizer.Step();
+  }
+  return loss;
+}
+
+}  // namespace
+
+TEST(MicrogradOptimizer, SGD) {
+  auto x = Value(1);
+  auto y = Value(2);
+  x.gradient(0.5);
+  y.gradient(-2);
+  auto sgd = SGD(std::vector<Value>{x, y}, /*learning_rate=*/0.1);
+  sgd.Step();
+  EXPECT_FLOAT_EQ(x.value(), 0.95);
+  EXPECT_FLOAT_EQ(y.value(), 2.2);
+  sgd.ZeroGrad();
+  EXPECT_FLOAT_EQ(x.gradient(), 0);
+  EXPECT_FLOAT_EQ(y.gradient(), 0);
+}
+
+TEST(MicrogradOptimizer, Momentum) {
+  auto x = Value(1);
+  auto sgd =
+      SGD(std::vector<Value>{x}, /*learning_rate=*/0.1, /*momentum=*/0.5);
+  x.gradient(1);
+  sgd.Step();
+  EXPECT_FLOAT_EQ(x.value(), 0.9);
+  sgd.Step();
+  // The velocity is now 0.5 * 1 + 1.
+  EXPECT_FLOAT_EQ(x.value(), 0.75);
+}
+
+TEST(MicrogradOptimizer, Adam) {
+  auto x = Value(1);
+  auto adam = Adam(std::vector<Value>{x}, /*learning_rate=*/0.1);
+  x.gradient(4);
+  adam.Step();
+  // The first step of Adam is the learning rate in the direction of the
+  // gradient, whatever its magnitude.
+  EXPECT_NEAR(x.value(), 0.9, 1e-6);
+  x.gradient(-4);
+  adam.Step();
+  float m = 0.9 * 0.1 * 4 + 0.1 * -4;
+  float v = 0.999 * 0.001 * 16 + 0.001 * 16;
+  float expected = 0.9 - 0.1 * (m / (1 - 0.81)) /
+                             (std::sqrt(v / (1 - 0.999 * 0.999)) + 1e-8);
+  EXPECT_NEAR(x.value(), expected, 1e-6);
+}
+
+TEST(MicrogradOptimizer, Converges) {
+  std::vector<Value> parameters = {Value(0), Value(0)};
+  auto sgd = SGD(parameters, /*learning_rate=*/0.1);
+  EXPECT_LT(Minimize(sgd, parameters, 100), 1e-6);
+  parameters = {Value(0), Value(0)};
+  auto momentum = SGD(parameters, /*learning_rate=*/0.05, /*momentum=*/0.9);
+  EXPECT_LT(Minimize(momentum, parameters, 200), 1e-6);
+  parameters = {Value(0), Value(0)};
+  auto adam = Adam(parameters, /*learning_rate=*/0.1);
+  EXPECT_LT(Minimize(adam, parameters, 300), 1e-4);
+}
+
+TEST(MicrogradOptimizer, Contiguous) {
+  auto buffer = ParameterBuffer(3);
+  std::span<float> values = buffer.values();
+  std::span<float> gradients = buffer.gradients();
+  values[0] = 1;
+  values[1] = 2;
+  values[2] = 3;
+  buffer.parameters()[1].gradient(-10);
+  gradients[2] = 10;
+  auto sgd = SGD(buffer.parameters(), /*learning_rate=*/0.1);
+  sgd.Step();
+  EXPECT_FLOAT_EQ(buffer.parameters()[0].value(), 1);
+  EXPECT_FLOAT_EQ(buffer.parameters()[1].value(), 3);
+  EXPECT_FLOAT_EQ(buffer.parameters()[2].value(), 2);
+  sgd.ZeroGrad();
+  EXPECT_FLOAT_EQ(gradients[1], 0);
+  EXPECT_FLOAT_EQ(buffer.parameters()[2].gradient(), 0);
+
+  // The same parameters in a different order are gathered instead.
+  std::vector<Value> reversed(buffer.parameters().rbegin(),
+                              buffer.parameters().rend());
+  gradients[0] = 1;
+  auto reversed_sgd = SGD(reversed, /*learning_rate=*/1);
+  reversed_sgd.Step();
+  EXPECT_FLOAT_EQ(values[0], 0);
+}
+
+TEST(MicrogradOptimizer, ParametersOnTape) {
+  Tape tape;
+  Tape::Scope scope(&tape);
+  EXPECT_THROW(SGD(std::vector<Value>{Value(1)}, 0.1), std::invalid_argument);
+}
+
+}  // namespace micrograd
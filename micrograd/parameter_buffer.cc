@@ -0,0 +1,67 @@
+#include "micrograd/parameter_buffer.h"
+
+#include <memory>
+#include <stdexcept>
+
+#include "micrograd/value_impl.h"
+
+namespace micrograd {
+
+template <Scalar T>
+struct BasicParameterBuffer<T>::Storage {
+  // The values of the parameters, followed by their gradients. Each
+  // parameter shares ownership of it, so a parameter that outlives the
+  // buffer can still be used.
+  std::shared_ptr<T[]> data;
+  size_t size = 0;
+  std::vector<BasicValue<T>> parameters;
+};
+
+template <Scalar T>
+BasicParameterBuffer<T>::BasicParameterBuffer(size_t size)
+    : storage_(std::make_shared<Storage>()), offset_(0), size_(size) {
+  storage_->data = std::make_shared<T[]>(2 * size);
+  storage_->size = size;
+  storage_->parameters.reserve(size);
+  T* values = storage_->data.get();
+  T* gradients = values + size;
+  for (size_t i = 0; i < size; ++i) {
+    storage_->parameters.push_back(BasicValue<T>(std::make_shared<ValueImpl<T>>(
+        storage_->data, &values[i], &gradients[i])));
+  }
+}
+
+template <Scalar T>
+BasicParameterBuffer<T>::BasicParameterBuffer(std::shared_ptr<Storage> storage,
+                                              size_t offset, size_t size)
+    : storage_(std::move(storage)), offset_(offset), size_(size) {}
+
+template <Scalar T>
+BasicParameterBuffer<T> BasicParameterBuffer<T>::Slice(size_t offset,
+                                                       size_t size) const {
+  if (offset + size > size_) {
+    throw std::out_of_range("slice is out of the bounds of the buffer");
+  }
+  return BasicParameterBuffer(storage_, offset_ + offset, size);
+}
+
+template <Scalar T>
+std::span<const BasicValue<T>> BasicParameterBuffer<T>::parameters() const {
+  return std::span(storage_->parameters).subspan(offset_, size_);
+}
+
+template <Scalar T>
+std::span<T> BasicParameterBuffer<T>::values() const {
+  return std::span(storage_->data.get() + offset_, size_);
+}
+
+template <Scalar T>
+std::span<T> BasicParameterBuffer<T>::gradients() const {
+  return std::span(storage_->data.get() + storage_->size + offset_, size_);
+}
+
+template class BasicParameterBuffer<float>;
+template class BasicParameterBuffer<double>;
+template class BasicParameterBuffer<BFloat16>;
+
+}  // namespace micrograd
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "micrograd/micrograd.h"
+
+namespace micrograd {
+
+/**
+ * A block of parameters whose values and gradients are stored in two
+ * contiguous arrays of scalars of type `T`.
+ *
+ * Each parameter is still a regular `Value` that can be used to build graphs,
+ * but its node reads and writes the arrays, so code that works on all the
+ * parameters at once (such as an optimizer or a checkpoint) can work on flat
+ * memory instead of chasing a pointer for each of them.
+ *
+ * Like `Value`, this class is a small wrapper over a shared pointer, so it is
+ * copy-able, but the underlying parameters are still the same. The parameters
+ * keep their values and gradients alive, so they can still be used after the
+ * last copy of the buffer is destroyed.
+ */
+template <Scalar T>
+class BasicParameterBuffer {
+ public:
+  // A buffer of `size` parameters that are all zero.
+  explicit BasicParameterBuffer(size_t size);
+
+  // The parameters [offset, offset + size) of this buffer.
+  BasicParameterBuffer Slice(size_t offset, size_t size) const;
+
+  size_t size() const { return size_; }
+
+  std::span<const BasicValue<T>> parameters() const;
+  std::span<T> values() const;
+  std::span<T> gradients() const;
+
+ private:
+  struct Storage;
+
+  BasicParameterBuffer(std::shared_ptr<Storage> storage, size_t offset,
+                       size_t size);
+
+  std::shared_ptr<Storage> storage_;
+  size_t offset_;
+  size_t size_;
+};
+
+using ParameterBuffer = BasicParameterBuffer<float>;
+
+extern template class BasicParameterBuffer<float>;
+extern template class BasicParameterBuffer<double>;
+extern template class BasicParameterBuffer<BFloat16>;
+
+}  // namespace micrograd
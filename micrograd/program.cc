@@ -0,0 +1,49 @@
+#include "micrograd/program.h"
+
+#include <stdexcept>
+
+namespace micrograd {
+
+Program::Program(std::span<const float> inputs, Function fn)
+    : tape_(std::make_unique<Tape>()) {
+  Tape::Scope scope(tape_.get());
+  std::vector<Value> values;
+  values.reserve(inputs.size());
+  for (float input : inputs) {
+    values.push_back(Value(input));
+    inputs_.push_back(values.back().index_);
+  }
+  for (const Value& output : fn(values)) {
+    // Constant outputs, or outputs that are one of the parameters, still need
+    // to be on the tape.
+    outputs_.push_back(tape_->Operand(output));
+  }
+}
+
+void Program::Forward(std::span<const float> inputs) {
+  if (inputs.size() != inputs_.size()) {
+    throw std::invalid_argument("wrong number of inputs for program");
+  }
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    tape_->value(inputs_[i], inputs[i]);
+  }
+  tape_->Forward();
+}
+
+void Program::Simplify() {
+  std::vector<uint32_t> map = tape_->Simplify(inputs_, outputs_);
+  for (uint32_t& index : inputs_) {
+    index = map[index];
+  }
+  for (uint32_t& index : outputs_) {
+    index = map[index];
+  }
+}
+
+void Program::Backward(size_t index) { tape_->Backward(outputs_.at(index)); }
+
+float Program::output(size_t index) const {
+  return tape_->value(outputs_.at(index));
+}
+
+}  // namespace micrograd
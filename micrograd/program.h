@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "micrograd/micrograd.h"
+#include "micrograd/tape.h"
+
+namespace micrograd {
+
+/**
+ * A computation that is traced once and can then be re-executed any number of
+ * times without building a graph.
+ *
+ * Training repeatedly builds the exact same graph, only the values flowing
+ * through it change. A program records the graph once onto a `Tape`, which is
+ * already a flat list of instructions (an op code and the indices of its
+ * operands) in topological order, and then replays that list for each step.
+ *
+ * Values created outside of the traced function (such as the parameters of a
+ * model) are re-read on every `Forward`, and `Backward` accumulates into their
+ * gradients like it would for a graph built on the heap.
+ *
+ * The traced function must build the same graph regardless of the values
+ * flowing through it, for example it must not branch on `Value::value()`.
+ */
+class Program {
+ public:
+  // The traced function is called with a value for each input, and the values
+  // it returns are the outputs of the program.
+  using Function =
+      absl::FunctionRef<std::vector<Value>(std::span<const Value> inputs)>;
+
+  // Trace `fn` using `inputs` as the initial values of its inputs.
+  Program(std::span<const float> inputs, Function fn);
+
+  // Re-execute the program with new values for the inputs, which must be the
+  // same length as the inputs it was traced with.
+  void Forward(std::span<const float> inputs);
+
+  /**
+   * Populate the gradient for the output at `index`, accumulating it into the
+   * values that were created outside of the program.
+   */
+  void Backward(size_t index = 0);
+
+  /**
+   * Shrink the program before running it many times: operations over
+   * constants are folded, operations with a constant operand use their scalar
+   * form, repeated subexpressions are computed once and operations that no
+   * output depends on are dropped.
+   *
+   * The outputs and the gradients of the values created outside of the
+   * program are the same as before, up to rounding.
+   */
+  void Simplify();
+
+  size_t number_of_outputs() const { return outputs_.size(); }
+  // The value of an output as of the last `Forward`.
+  float output(size_t index) const;
+
+  // The number of instructions in the program.
+  size_t size() const { return tape_->size(); }
+
+ private:
+  std::unique_ptr<Tape> tape_;
+  std::vector<uint32_t> inputs_;
+  std::vector<uint32_t> outputs_;
+};
+
+}  // namespace micrograd
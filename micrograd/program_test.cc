@@ -0,0 +1,108 @@
+#include "micrograd/program.h"
+
+#include <gtest/gtest.h>
+
+#include "micrograd/nn.h"
+
+namespace micrograd {
+
+TEST(MicrogradProgram, Replay) {
+  auto w = Value(2);
+  auto program = Program(std::vector<float>{3, 4}, [&](auto inputs) {
+    Value x = inputs[0];
+    Value y = inputs[1];
+    Value z = x.Multiply(w).Add(y.Pow(2)).Relu();
+    return std::vector<Value>{z, x.Add(1)};
+  });
+  ASSERT_EQ(program.number_of_outputs(), 2);
+  EXPECT_FLOAT_EQ(program.output(0), 22);
+  EXPECT_FLOAT_EQ(program.output(1), 4);
+  program.Backward();
+  EXPECT_FLOAT_EQ(w.gradient(), 3);
+
+  // New inputs and a new value for the parameter.
+  size_t size = program.size();
+  w.value(-1);
+  w.gradient(0);
+  program.Forward(std::vector<float>{5, 1});
+  EXPECT_EQ(program.size(), size);
+  EXPECT_FLOAT_EQ(program.output(0), 0);
+  EXPECT_FLOAT_EQ(program.output(1), 6);
+  program.Backward();
+  EXPECT_FLOAT_EQ(w.gradient(), 0);
+  program.Forward(std::vector<float>{1, 3});
+  EXPECT_FLOAT_EQ(program.output(0), 8);
+  program.Backward();
+  program.Backward();
+  EXPECT_FLOAT_EQ(w.gradient(), 2);
+
+  EXPECT_THROW(program.Forward(std::vector<float>{1}), std::invalid_argument);
+}
+
+TEST(MicrogradProgram, Simplify) {
+  auto w = Value(2);
+  auto fn = [&](std::span<const Value> inputs) {
+    Value x = inputs[0];
+    Value y = inputs[1];
+    Value scale = Value(2).Multiply(Value(3));
+    Value a = x.Multiply(w).Add(y.Subtract(Value(1)));
+    Value b = x.Multiply(w).Multiply(scale);
+    Value unused = y.Pow(3);
+    return std::vector<Value>{a.Add(b).Multiply(Value(1)), w.Multiply(x)};
+  };
+  auto program = Program(std::vector<float>{3, 4}, fn);
+  auto simplified = Program(std::vector<float>{3, 4}, fn);
+  simplified.Simplify();
+  EXPECT_EQ(program.size(), 17);
+  // The inputs, `w`, x * w (shared by all three uses), y - 1, a, b and a + b.
+  EXPECT_EQ(simplified.size(), 8);
+
+  std::vector<std::vector<float>> inputs = {{3, 4}, {-1, 0.5}};
+  for (const auto& input : inputs) {
+    for (Program* p : {&program, &simplified}) {
+      w.gradient(0);
+      p->Forward(input);
+      EXPECT_FLOAT_EQ(p->output(0), 7 * input[0] * w.value() + input[1] - 1);
+      EXPECT_FLOAT_EQ(p->output(1), input[0] * w.value());
+      p->Backward();
+      EXPECT_FLOAT_EQ(w.gradient(), 7 * input[0]);
+      p->Backward(1);
+      EXPECT_FLOAT_EQ(w.gradient(), 8 * input[0]);
+    }
+    w.value(w.value() - 3);
+  }
+}
+
+TEST(MicrogradProgram, MatchesGraph) {
+  auto model = MLP(3, std::vector<size_t>{4, 4, 1});
+  auto program =
+      Program(std::vector<float>{0, 0, 0}, [&](std::span<const Value> x) {
+        return model(x);
+      });
+  std::vector<std::vector<float>> inputs = {
+      {2, 3, -1}, {3, -1, 0.5}, {0.5, 1, 1}};
+  for (const auto& input : inputs) {
+    std::vector<Value> x;
+    for (float f : input) {
+      x.push_back(Value(f));
+    }
+    Value expected = model(x).front();
+    expected.Backward();
+    std::vector<float> gradients;
+    for (const Value& p : model.Parameters()) {
+      gradients.push_back(p.gradient());
+      p.gradient(0);
+    }
+
+    program.Forward(input);
+    EXPECT_FLOAT_EQ(program.output(0), expected.value());
+    program.Backward();
+    std::span<const Value> parameters = model.Parameters();
+    for (size_t i = 0; i < parameters.size(); ++i) {
+      EXPECT_FLOAT_EQ(parameters[i].gradient(), gradients[i]);
+      parameters[i].gradient(0);
+    }
+  }
+}
+
+}  // namespace micrograd
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "micrograd/kernels.h"
+
+namespace micrograd {
+
+/**
+ * A 16-bit brain floating point number: the upper half of a `float`, with
+ * the same range but only 8 bits of precision.
+ *
+ * This is a storage type, arithmetic converts to `float` and the result is
+ * rounded back (to nearest, ties to even) when it is stored. It halves the
+ * memory of large graphs, at the cost of precision.
+ */
+class BFloat16 {
+ public:
+  BFloat16() = default;
+  BFloat16(float f) : bits_(Round(f)) {}
+
+  operator float() const {
+    return std::bit_cast<float>(static_cast<uint32_t>(bits_) << 16);
+  }
+
+  BFloat16& operator+=(float other) { return *this = *this + other; }
+  BFloat16& operator-=(float other) { return *this = *this - other; }
+  BFloat16& operator*=(float other) { return *this = *this * other; }
+
+ private:
+  static uint16_t Round(float f) {
+    uint32_t bits = std::bit_cast<uint32_t>(f);
+    if (std::isnan(f)) {
+      // Keep it a NaN, even if the payload is only in the low bits.
+      return static_cast<uint16_t>(bits >> 16) | 0x40;
+    }
+    uint32_t rounding = 0x7fff + ((bits >> 16) & 1);
+    return static_cast<uint16_t>((bits + rounding) >> 16);
+  }
+
+  uint16_t bits_ = 0;
+};
+static_assert(sizeof(BFloat16) == 2);
+
+// The scalar types the engine is instantiated with.
+template <typename T>
+concept Scalar = std::is_same_v<T, float> || std::is_same_v<T, double> ||
+                 std::is_same_v<T, BFloat16>;
+
+// The type sums of `T` are accumulated in, so a long sum of 16-bit values
+// doesn't round at every step.
+template <Scalar T>
+using Accumulator =
+    std::conditional_t<std::is_same_v<T, double>, double, float>;
+
+// Loops over contiguous scalars of any type, which use the vectorized kernels
+// for floats. Other types are summed into several independent accumulators,
+// so the loop isn't bound by the latency of a single chain of additions.
+namespace scalar {
+
+constexpr size_t kLanes = 8;
+
+// Returns the sum of term(i) for i in [0, n).
+template <Scalar T, typename Term>
+Accumulator<T> Reduce(size_t n, Term term) {
+  Accumulator<T> lanes[kLanes] = {};
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (size_t j = 0; j < kLanes; ++j) {
+      lanes[j] += term(i + j);
+    }
+  }
+  for (; i < n; ++i) {
+    lanes[0] += term(i);
+  }
+  Accumulator<T> sum = 0;
+  for (Accumulator<T> lane : lanes) {
+    sum += lane;
+  }
+  return sum;
+}
+
+// Returns the sum of a[i] * b[i].
+template <Scalar T>
+T Dot(const T* a, const T* b, size_t n) {
+  if constexpr (std::is_same_v<T, float>) {
+    return kernels::Dot(a, b, n);
+  } else {
+    return Reduce<T>(n, [&](size_t i) {
+      return Accumulator<T>(a[i]) * Accumulator<T>(b[i]);
+    });
+  }
+}
+
+// Returns the sum of a[i].
+template <Scalar T>
+T Sum(const T* a, size_t n) {
+  if constexpr (std::is_same_v<T, float>) {
+    return kernels::Sum(a, n);
+  } else {
+    return Reduce<T>(n, [&](size_t i) { return Accumulator<T>(a[i]); });
+  }
+}
+
+// Loss functions of `n` predictions `p` and targets `t`, and their
+// gradients: `dp` and `dt` are set to the derivatives of the loss with
+// respect to each p[i] and t[i].
+
+// The mean of max(0, 1 - t[i] * p[i]), for targets of -1 or 1.
+template <Scalar T>
+T Hinge(const T* p, const T* t, size_t n) {
+  using A = Accumulator<T>;
+  A sum = Reduce<T>(n, [&](size_t i) {
+    return std::max<A>(A(1) - A(t[i]) * A(p[i]), 0);
+  });
+  return sum / n;
+}
+
+template <Scalar T>
+void HingeGradient(const T* p, const T* t, size_t n, T* dp, T* dt) {
+  using A = Accumulator<T>;
+  A scale = A(1) / n;
+  for (size_t i = 0; i < n; ++i) {
+    A active = A(1) - A(t[i]) * A(p[i]) > 0 ? -scale : 0;
+    dp[i] = active * A(t[i]);
+    dt[i] = active * A(p[i]);
+  }
+}
+
+// The mean of (p[i] - t[i])^2.
+template <Scalar T>
+T MeanSquaredError(const T* p, const T* t, size_t n) {
+  using A = Accumulator<T>;
+  A sum = Reduce<T>(n, [&](size_t i) {
+    A error = A(p[i]) - A(t[i]);
+    return error * error;
+  });
+  return sum / n;
+}
+
+template <Scalar T>
+void MeanSquaredErrorGradient(const T* p, const T* t, size_t n, T* dp,
+                              T* dt) {
+  using A = Accumulator<T>;
+  A scale = A(2) / n;
+  for (size_t i = 0; i < n; ++i) {
+    A d = (A(p[i]) - A(t[i])) * scale;
+    dp[i] = d;
+    dt[i] = -d;
+  }
+}
+
+// The log of the sum of exp(p[i]), computed without overflowing.
+template <Scalar T>
+Accumulator<T> LogSumExp(const T* p, size_t n) {
+  using A = Accumulator<T>;
+  A max = p[0];
+  for (size_t i = 1; i < n; ++i) {
+    max = std::max<A>(max, p[i]);
+  }
+  return max + std::log(Reduce<T>(n, [&](size_t i) {
+           return std::exp(A(p[i]) - max);
+         }));
+}
+
+// The mean over each row of `classes` logits `p` of the cross-entropy between
+// the target probabilities `t` and the softmax of the logits.
+template <Scalar T>
+T SoftmaxCrossEntropy(const T* p, const T* t, size_t n, size_t classes) {
+  using A = Accumulator<T>;
+  A sum = 0;
+  for (size_t row = 0; row < n; row += classes) {
+    A log_sum = LogSumExp(p + row, classes);
+    // -log(softmax(p)[i]) is log_sum - p[i].
+    sum += Reduce<T>(classes, [&](size_t i) {
+      return A(t[row + i]) * (log_sum - A(p[row + i]));
+    });
+  }
+  return sum / (n / classes);
+}
+
+template <Scalar T>
+void SoftmaxCrossEntropyGradient(const T* p, const T* t, size_t n,
+                                 size_t classes, T* dp, T* dt) {
+  using A = Accumulator<T>;
+  A scale = A(1) / (n / classes);
+  for (size_t row = 0; row < n; row += classes) {
+    A log_sum = LogSumExp(p + row, classes);
+    A total = Reduce<T>(classes, [&](size_t i) { return A(t[row + i]); });
+    for (size_t i = row; i < row + classes; ++i) {
+      A softmax = std::exp(A(p[i]) - log_sum);
+      dp[i] = (softmax * total - A(t[i])) * scale;
+      dt[i] = (log_sum - A(p[i])) * scale;
+    }
+  }
+}
+
+}  // namespace scalar
+
+}  // namespace micrograd
@@ -0,0 +1,574 @@
+#include "micrograd/tape.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include "micrograd/kernels.h"
+#include "micrograd/scalar.h"
+
+namespace micrograd {
+
+namespace {
+
+thread_local Tape* current_tape = nullptr;
+
+// Whether `operands` are (non-empty and) consecutive on the tape.
+bool Contiguous(std::span<const uint32_t> operands) {
+  for (size_t i = 1; i < operands.size(); ++i) {
+    if (operands[i] != operands[0] + i) {
+      return false;
+    }
+  }
+  return !operands.empty();
+}
+
+// Whether the operands of `op` are a list in `operands_`.
+bool HasOperandList(Op op) {
+  return op == Op::kDot || op == Op::kSum || op == Op::kHinge ||
+         op == Op::kMeanSquaredError || op == Op::kSoftmaxCrossEntropy;
+}
+
+}  // namespace
+
+Tape::Scope::Scope(Tape* tape) : previous_(current_tape) {
+  current_tape = tape;
+}
+
+Tape::Scope::~Scope() { current_tape = previous_; }
+
+Tape* Tape::Current() { return current_tape; }
+
+void Tape::Reset() {
+  nodes_.clear();
+  values_.clear();
+  grads_.clear();
+  operands_.clear();
+  bindings_.clear();
+  bound_.clear();
+}
+
+uint32_t Tape::Operand(const Value& v) {
+  if (v.tape_ == this) {
+    return v.index_;
+  }
+  if (v.tape_ != nullptr) {
+    throw std::invalid_argument("values are recorded on different tapes");
+  }
+  auto [it, inserted] = bound_.try_emplace(v.impl_.get(), nodes_.size());
+  if (inserted) {
+    bindings_.emplace_back(it->second, v.impl_);
+    Record({.op = Op::kNone}, v.impl_->value());
+  }
+  return it->second;
+}
+
+bool Tape::Operands(std::span<const Value> values) {
+  size_t start = operands_.size();
+  bool contiguous = !values.empty();
+  for (size_t i = 0; i < values.size(); ++i) {
+    // Leaves that are bound for the first time are recorded next to each
+    // other, so the weights of a neuron end up consecutive on the tape.
+    uint32_t index = Operand(values[i]);
+    if (i > 0 && index != operands_[start] + i) {
+      contiguous = false;
+    }
+    operands_.push_back(index);
+  }
+  return contiguous;
+}
+
+uint32_t Tape::Leaf(float value) { return Record({.op = Op::kNone}, value); }
+
+uint32_t Tape::Add(uint32_t lhs, uint32_t rhs) {
+  return Record({.op = Op::kAdd, .lhs = lhs, .rhs = rhs});
+}
+
+uint32_t Tape::Subtract(uint32_t lhs, uint32_t rhs) {
+  return Record({.op = Op::kSubtract, .lhs = lhs, .rhs = rhs});
+}
+
+uint32_t Tape::Multiply(uint32_t lhs, uint32_t rhs) {
+  return Record({.op = Op::kMultiply, .lhs = lhs, .rhs = rhs});
+}
+
+uint32_t Tape::Divide(uint32_t lhs, uint32_t rhs) {
+  return Record({.op = Op::kDivide, .lhs = lhs, .rhs = rhs});
+}
+
+uint32_t Tape::Negate(uint32_t lhs) {
+  return Record({.op = Op::kNegate, .lhs = lhs});
+}
+
+uint32_t Tape::AddConstant(uint32_t lhs, float constant) {
+  return Record({.op = Op::kAddConstant, .arg = constant, .lhs = lhs});
+}
+
+uint32_t Tape::MultiplyConstant(uint32_t lhs, float constant) {
+  return Record({.op = Op::kMultiplyConstant, .arg = constant, .lhs = lhs});
+}
+
+uint32_t Tape::Pow(uint32_t lhs, float exponent) {
+  return Record({.op = Op::kPow, .arg = exponent, .lhs = lhs});
+}
+
+uint32_t Tape::Relu(uint32_t lhs) {
+  return Record({.op = Op::kReLU, .lhs = lhs});
+}
+
+uint32_t Tape::Dot(std::span<const Value> w, std::span<const Value> x) {
+  uint32_t offset = operands_.size();
+  bool contiguous_lhs = Operands(w);
+  bool contiguous_rhs = Operands(x);
+  return Record({.op = Op::kDot,
+                 .contiguous_lhs = contiguous_lhs,
+                 .contiguous_rhs = contiguous_rhs,
+                 .lhs = offset,
+                 .rhs = static_cast<uint32_t>(w.size())});
+}
+
+uint32_t Tape::Sum(std::span<const Value> values) {
+  uint32_t offset = operands_.size();
+  bool contiguous = Operands(values);
+  return Record({.op = Op::kSum,
+                 .contiguous_lhs = contiguous,
+                 .lhs = offset,
+                 .rhs = static_cast<uint32_t>(values.size())});
+}
+
+uint32_t Tape::Loss(Op op, std::span<const Value> predictions,
+                    std::span<const Value> targets, size_t classes) {
+  uint32_t offset = operands_.size();
+  bool contiguous_lhs = Operands(predictions);
+  bool contiguous_rhs = Operands(targets);
+  return Record({.op = op,
+                 .contiguous_lhs = contiguous_lhs,
+                 .contiguous_rhs = contiguous_rhs,
+                 .arg = static_cast<float>(classes),
+                 .lhs = offset,
+                 .rhs = static_cast<uint32_t>(predictions.size())});
+}
+
+uint32_t Tape::Record(Node node) { return Record(node, Evaluate(node)); }
+
+uint32_t Tape::Record(Node node, float value) {
+  uint32_t index = nodes_.size();
+  nodes_.push_back(node);
+  values_.push_back(value);
+  grads_.push_back(0.0);
+  return index;
+}
+
+float Tape::Evaluate(const Node& node) {
+  switch (node.op) {
+    case Op::kNone:
+      break;
+    case Op::kAdd:
+      return values_[node.lhs] + values_[node.rhs];
+    case Op::kSubtract:
+      return values_[node.lhs] - values_[node.rhs];
+    case Op::kMultiply:
+      return values_[node.lhs] * values_[node.rhs];
+    case Op::kDivide:
+      return values_[node.lhs] / values_[node.rhs];
+    case Op::kNegate:
+      return -values_[node.lhs];
+    case Op::kAddConstant:
+      return values_[node.lhs] + node.arg;
+    case Op::kMultiplyConstant:
+      return values_[node.lhs] * node.arg;
+    case Op::kPow:
+      return std::pow(values_[node.lhs], node.arg);
+    case Op::kReLU:
+      return values_[node.lhs] < 0 ? 0 : values_[node.lhs];
+    case Op::kDot: {
+      uint32_t n = node.rhs;
+      const uint32_t* operands = operands_.data() + node.lhs;
+      return kernels::Dot(
+          Gather(operands, n, node.contiguous_lhs, &scratch_lhs_),
+          Gather(operands + n, n, node.contiguous_rhs, &scratch_rhs_), n);
+    }
+    case Op::kSum: {
+      const uint32_t* operands = operands_.data() + node.lhs;
+      return kernels::Sum(
+          Gather(operands, node.rhs, node.contiguous_lhs, &scratch_lhs_),
+          node.rhs);
+    }
+    case Op::kHinge:
+    case Op::kMeanSquaredError:
+    case Op::kSoftmaxCrossEntropy: {
+      uint32_t n = node.rhs;
+      const uint32_t* operands = operands_.data() + node.lhs;
+      const float* p = Gather(operands, n, node.contiguous_lhs, &scratch_lhs_);
+      const float* t =
+          Gather(operands + n, n, node.contiguous_rhs, &scratch_rhs_);
+      if (node.op == Op::kHinge) {
+        return scalar::Hinge(p, t, n);
+      } else if (node.op == Op::kMeanSquaredError) {
+        return scalar::MeanSquaredError(p, t, n);
+      }
+      return scalar::SoftmaxCrossEntropy(p, t, n,
+                                         static_cast<size_t>(node.arg));
+    }
+  }
+  throw std::logic_error("leaves can not be evaluated");
+}
+
+void Tape::Forward() {
+  // Pick up any changes to the leaves that live outside of the tape, such as
+  // parameters that were updated since the last pass.
+  for (const auto& [index, impl] : bindings_) {
+    values_[index] = impl->value();
+  }
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    if (nodes_[i].op != Op::kNone) {
+      values_[i] = Evaluate(nodes_[i]);
+    }
+  }
+}
+
+void Tape::Backward(uint32_t root) {
+  Propagate(root);
+  // Flush the gradients of the leaves that live outside of the tape, so they
+  // accumulate the same way as if the graph was built on the heap.
+  for (auto& [index, impl] : bindings_) {
+    impl->grad(impl->grad() + grads_[index]);
+    grads_[index] = 0.0;
+  }
+}
+
+void Tape::Propagate(uint32_t root) {
+  // Only leaves accumulate gradients across backward passes.
+  for (uint32_t i = 0; i <= root; ++i) {
+    if (nodes_[i].op != Op::kNone) {
+      grads_[i] = 0.0;
+    }
+  }
+  grads_[root] = 1.0;
+  for (uint32_t i = root + 1; i-- > 0;) {
+    const Node& node = nodes_[i];
+    float grad = grads_[i];
+    switch (node.op) {
+      case Op::kNone:
+        break;
+      case Op::kAdd:
+        grads_[node.lhs] += grad;
+        grads_[node.rhs] += grad;
+        break;
+      case Op::kSubtract:
+        grads_[node.lhs] += grad;
+        grads_[node.rhs] -= grad;
+        break;
+      case Op::kMultiply:
+        grads_[node.lhs] += values_[node.rhs] * grad;
+        grads_[node.rhs] += values_[node.lhs] * grad;
+        break;
+      case Op::kDivide:
+        grads_[node.lhs] += grad / values_[node.rhs];
+        grads_[node.rhs] -= (values_[i] / values_[node.rhs]) * grad;
+        break;
+      case Op::kNegate:
+        grads_[node.lhs] -= grad;
+        break;
+      case Op::kAddConstant:
+        grads_[node.lhs] += grad;
+        break;
+      case Op::kMultiplyConstant:
+        grads_[node.lhs] += node.arg * grad;
+        break;
+      case Op::kPow:
+        grads_[node.lhs] +=
+            (node.arg * std::pow(values_[node.lhs], node.arg - 1)) * grad;
+        break;
+      case Op::kReLU:
+        grads_[node.lhs] += values_[i] > 0 ? grad : 0;
+        break;
+      case Op::kDot: {
+        uint32_t n = node.rhs;
+        const uint32_t* w = operands_.data() + node.lhs;
+        const uint32_t* x = w + n;
+        const float* w_values =
+            Gather(w, n, node.contiguous_lhs, &scratch_lhs_);
+        const float* x_values =
+            Gather(x, n, node.contiguous_rhs, &scratch_rhs_);
+        Accumulate(grad, x_values, w, n, node.contiguous_lhs);
+        Accumulate(grad, w_values, x, n, node.contiguous_rhs);
+        break;
+      }
+      case Op::kSum: {
+        const uint32_t* operands = operands_.data() + node.lhs;
+        if (node.contiguous_lhs) {
+          float* grads = &grads_[operands[0]];
+          for (uint32_t j = 0; j < node.rhs; ++j) {
+            grads[j] += grad;
+          }
+        } else {
+          for (uint32_t j = 0; j < node.rhs; ++j) {
+            grads_[operands[j]] += grad;
+          }
+        }
+        break;
+      }
+      case Op::kHinge:
+      case Op::kMeanSquaredError:
+      case Op::kSoftmaxCrossEntropy: {
+        uint32_t n = node.rhs;
+        const uint32_t* predictions = operands_.data() + node.lhs;
+        const uint32_t* targets = predictions + n;
+        const float* p =
+            Gather(predictions, n, node.contiguous_lhs, &scratch_lhs_);
+        const float* t =
+            Gather(targets, n, node.contiguous_rhs, &scratch_rhs_);
+        scratch_gradients_.resize(2 * n);
+        float* dp = scratch_gradients_.data();
+        float* dt = dp + n;
+        if (node.op == Op::kHinge) {
+          scalar::HingeGradient(p, t, n, dp, dt);
+        } else if (node.op == Op::kMeanSquaredError) {
+          scalar::MeanSquaredErrorGradient(p, t, n, dp, dt);
+        } else {
+          scalar::SoftmaxCrossEntropyGradient(
+              p, t, n, static_cast<size_t>(node.arg), dp, dt);
+        }
+        Accumulate(grad, dp, predictions, n, node.contiguous_lhs);
+        Accumulate(grad, dt, targets, n, node.contiguous_rhs);
+        break;
+      }
+    }
+  }
+}
+
+float Tape::BoundGradient(const Value& v) const {
+  auto it = bound_.find(v.impl_.get());
+  return it == bound_.end() ? 0.0 : grads_[it->second];
+}
+
+const float* Tape::Gather(const uint32_t* operands, uint32_t n,
+                          bool contiguous, std::vector<float>* scratch) const {
+  if (contiguous) {
+    return &values_[operands[0]];
+  }
+  scratch->resize(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    (*scratch)[i] = values_[operands[i]];
+  }
+  return scratch->data();
+}
+
+void Tape::Accumulate(float alpha, const float* x, const uint32_t* operands,
+                      uint32_t n, bool contiguous) {
+  if (contiguous) {
+    kernels::Axpy(alpha, x, &grads_[operands[0]], n);
+    return;
+  }
+  for (uint32_t i = 0; i < n; ++i) {
+    grads_[operands[i]] += alpha * x[i];
+  }
+}
+
+std::vector<uint32_t> Tape::OperandsOf(const Node& node) const {
+  switch (node.op) {
+    case Op::kNone:
+      break;
+    case Op::kAdd:
+    case Op::kSubtract:
+    case Op::kMultiply:
+    case Op::kDivide:
+      return {node.lhs, node.rhs};
+    case Op::kNegate:
+    case Op::kAddConstant:
+    case Op::kMultiplyConstant:
+    case Op::kPow:
+    case Op::kReLU:
+      return {node.lhs};
+    case Op::kDot:
+    case Op::kSum:
+    case Op::kHinge:
+    case Op::kMeanSquaredError:
+    case Op::kSoftmaxCrossEntropy: {
+      uint32_t n = node.op == Op::kSum ? node.rhs : 2 * node.rhs;
+      return std::vector(operands_.begin() + node.lhs,
+                         operands_.begin() + node.lhs + n);
+    }
+  }
+  return {};
+}
+
+uint32_t Tape::Record(Op op, float arg, std::span<const uint32_t> operands) {
+  switch (op) {
+    case Op::kNone:
+      break;
+    case Op::kAdd:
+    case Op::kSubtract:
+    case Op::kMultiply:
+    case Op::kDivide:
+      return Record({.op = op, .lhs = operands[0], .rhs = operands[1]});
+    case Op::kNegate:
+    case Op::kAddConstant:
+    case Op::kMultiplyConstant:
+    case Op::kPow:
+    case Op::kReLU:
+      return Record({.op = op, .arg = arg, .lhs = operands[0]});
+    case Op::kDot:
+    case Op::kSum:
+    case Op::kHinge:
+    case Op::kMeanSquaredError:
+    case Op::kSoftmaxCrossEntropy: {
+      uint32_t offset = operands_.size();
+      operands_.insert(operands_.end(), operands.begin(), operands.end());
+      uint32_t n = op == Op::kSum ? operands.size() : operands.size() / 2;
+      return Record({.op = op,
+                     .contiguous_lhs = Contiguous(operands.first(n)),
+                     .contiguous_rhs = op != Op::kSum &&
+                                       Contiguous(operands.subspan(n)),
+                     .arg = arg,
+                     .lhs = offset,
+                     .rhs = n});
+    }
+  }
+  throw std::logic_error("leaves have no operands");
+}
+
+std::vector<uint32_t> Tape::Simplify(std::span<const uint32_t> variables,
+                                     std::span<const uint32_t> roots) {
+  std::vector<bool> variable(nodes_.size(), false);
+  for (uint32_t index : variables) {
+    variable[index] = true;
+  }
+  for (const auto& [index, impl] : bindings_) {
+    variable[index] = true;
+  }
+
+  // Fold and merge the nodes into `folded`, in the same order.
+  Tape folded;
+  std::vector<bool> constant;
+  // The key of every constant and operation in `folded`: its op, its scalar
+  // argument (as bits, so -0 and 0 are different) and its operands.
+  using Key = std::tuple<Op, uint32_t, std::vector<uint32_t>>;
+  absl::flat_hash_map<Key, uint32_t> existing;
+  auto constant_leaf = [&](float value) {
+    auto [it, inserted] = existing.try_emplace(
+        Key(Op::kNone, std::bit_cast<uint32_t>(value), {}), folded.size());
+    if (inserted) {
+      folded.Leaf(value);
+      constant.push_back(true);
+    }
+    return it->second;
+  };
+  std::vector<uint32_t> map(nodes_.size());
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    const Node& node = nodes_[i];
+    if (node.op == Op::kNone) {
+      if (variable[i]) {
+        map[i] = folded.Leaf(values_[i]);
+        constant.push_back(false);
+      } else {
+        map[i] = constant_leaf(values_[i]);
+      }
+      continue;
+    }
+    std::vector<uint32_t> operands = OperandsOf(node);
+    for (uint32_t& operand : operands) {
+      operand = map[operand];
+    }
+    if (std::all_of(operands.begin(), operands.end(),
+                    [&](uint32_t operand) { return constant[operand]; })) {
+      // The constants haven't changed since this was evaluated.
+      map[i] = constant_leaf(values_[i]);
+      continue;
+    }
+    Op op = node.op;
+    float arg = node.arg;
+    if (operands.size() == 2 && !HasOperandList(op)) {
+      // Operations that are commutative, or whose constant is on the right,
+      // have a scalar form.
+      bool lhs = constant[operands[0]];
+      bool rhs = constant[operands[1]];
+      if (lhs || rhs) {
+        float c = folded.values_[operands[lhs ? 0 : 1]];
+        uint32_t x = operands[lhs ? 1 : 0];
+        if (op == Op::kAdd || (op == Op::kSubtract && rhs)) {
+          arg = op == Op::kAdd ? c : -c;
+          op = Op::kAddConstant;
+          operands = {x};
+        } else if (op == Op::kMultiply || (op == Op::kDivide && rhs)) {
+          arg = op == Op::kMultiply ? c : 1 / c;
+          op = Op::kMultiplyConstant;
+          operands = {x};
+        }
+      }
+      if ((op == Op::kAdd || op == Op::kMultiply) &&
+          operands[0] > operands[1]) {
+        std::swap(operands[0], operands[1]);
+      }
+    }
+    // Operations that return their operand.
+    if ((op == Op::kAddConstant && arg == 0) ||
+        ((op == Op::kMultiplyConstant || op == Op::kPow) && arg == 1)) {
+      map[i] = operands[0];
+      continue;
+    }
+    auto [it, inserted] = existing.try_emplace(
+        Key(op, std::bit_cast<uint32_t>(arg), operands), folded.size());
+    if (inserted) {
+      folded.Record(op, arg, operands);
+      constant.push_back(false);
+    }
+    map[i] = it->second;
+  }
+
+  // Drop the nodes that nothing depends on, walking the folded tape from its
+  // last node to its first so the users of a node are visited before it.
+  std::vector<bool> live(folded.size(), false);
+  for (std::span<const uint32_t> indices : {variables, roots}) {
+    for (uint32_t index : indices) {
+      live[map[index]] = true;
+    }
+  }
+  for (const auto& [index, impl] : bindings_) {
+    live[map[index]] = true;
+  }
+  for (uint32_t i = folded.size(); i-- > 0;) {
+    if (live[i]) {
+      for (uint32_t operand : folded.OperandsOf(folded.nodes_[i])) {
+        live[operand] = true;
+      }
+    }
+  }
+  Tape simplified;
+  std::vector<uint32_t> moved(folded.size(), kDropped);
+  for (uint32_t i = 0; i < folded.size(); ++i) {
+    if (!live[i]) {
+      continue;
+    }
+    const Node& node = folded.nodes_[i];
+    if (node.op == Op::kNone) {
+      moved[i] = simplified.Leaf(folded.values_[i]);
+      continue;
+    }
+    std::vector<uint32_t> operands = folded.OperandsOf(node);
+    for (uint32_t& operand : operands) {
+      operand = moved[operand];
+    }
+    moved[i] = simplified.Record(node.op, node.arg, operands);
+  }
+  for (uint32_t& index : map) {
+    index = moved[index];
+  }
+
+  nodes_ = std::move(simplified.nodes_);
+  values_ = std::move(simplified.values_);
+  grads_ = std::move(simplified.grads_);
+  operands_ = std::move(simplified.operands_);
+  bound_.clear();
+  for (auto& [index, impl] : bindings_) {
+    index = map[index];
+    bound_[impl.get()] = index;
+  }
+  return map;
+}
+
+}  // namespace micrograd
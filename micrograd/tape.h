@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "micrograd/micrograd.h"
+#include "micrograd/value_impl.h"
+
+namespace micrograd {
+
+/**
+ * An arena that records expressions into flat arrays instead of allocating a
+ * node on the heap for every operation.
+ *
+ * While a `Tape::Scope` is active on a thread, every `Value` created on that
+ * thread is recorded on the tape, and the resulting `Value` is a cheap handle
+ * (the tape and an index) into it. Operations on values that live on a tape
+ * are recorded on the same tape. Values that were created outside of any tape
+ * (such as the parameters of a model) are recorded as leaves that refer back
+ * to the original node, and `Backward` accumulates their gradients into it.
+ *
+ * Since operands are always recorded before the operations that use them, the
+ * tape is already in topological order and `Backward` is a single reverse
+ * sweep over it.
+ *
+ * Values recorded on a tape must not be used after `Reset`, which clears the
+ * tape but keeps its memory around so the next step does not allocate.
+ */
+class Tape {
+ public:
+  Tape() = default;
+  Tape(const Tape&) = delete;
+  Tape& operator=(const Tape&) = delete;
+
+  // Record all values created on this thread onto `tape` for the lifetime of
+  // the scope. Scopes can be nested, the innermost scope wins.
+  class Scope {
+   public:
+    explicit Scope(Tape* tape);
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope();
+
+   private:
+    Tape* previous_;
+  };
+
+  // The tape of the innermost active scope on this thread, if any.
+  static Tape* Current();
+
+  // Drop all the recorded values, retaining the allocated memory.
+  void Reset();
+
+  // The number of values recorded on this tape.
+  size_t size() const { return nodes_.size(); }
+
+ private:
+  friend class DataParallel;
+  friend class Program;
+  template <Scalar>
+  friend class BasicValue;
+  template <Scalar>
+  friend class GraphWriter;
+
+  struct Node {
+    Op op;
+    // For operations over lists of operands (`Op::kDot`, `Op::kSum` and the
+    // loss functions), whether the values in each list are consecutive on
+    // the tape, so they can be used in place instead of being gathered.
+    bool contiguous_lhs = false;
+    bool contiguous_rhs = false;
+    // The exponent for `Op::kPow`, the constant operand of
+    // `Op::kAddConstant` and `Op::kMultiplyConstant`, or the number of
+    // classes of `Op::kSoftmaxCrossEntropy`.
+    float arg;
+    // The operands of the node. For operations over a list of operands this
+    // is instead the offset of the list in `operands_`, and its length.
+    uint32_t lhs;
+    uint32_t rhs;
+  };
+
+  // The index of `v` on this tape, recording it as a leaf if it was not
+  // created on a tape.
+  uint32_t Operand(const Value& v);
+  // Append the indices of `values` to `operands_`, and returns if they are
+  // (non-empty and) consecutive on the tape.
+  bool Operands(std::span<const Value> values);
+
+  uint32_t Leaf(float value);
+  uint32_t Add(uint32_t lhs, uint32_t rhs);
+  uint32_t Subtract(uint32_t lhs, uint32_t rhs);
+  uint32_t Multiply(uint32_t lhs, uint32_t rhs);
+  uint32_t Divide(uint32_t lhs, uint32_t rhs);
+  uint32_t Negate(uint32_t lhs);
+  uint32_t AddConstant(uint32_t lhs, float constant);
+  uint32_t MultiplyConstant(uint32_t lhs, float constant);
+  uint32_t Pow(uint32_t lhs, float exponent);
+  uint32_t Relu(uint32_t lhs);
+  uint32_t Dot(std::span<const Value> w, std::span<const Value> x);
+  uint32_t Sum(std::span<const Value> values);
+  uint32_t Loss(Op op, std::span<const Value> predictions,
+                std::span<const Value> targets, size_t classes);
+
+  // Re-evaluate every operation on the tape in order, after refreshing the
+  // values of the leaves that were created outside of it.
+  void Forward();
+  void Backward(uint32_t root);
+  // Back propagate from `root`, but leave the gradients of the leaves that
+  // were created outside of the tape on the tape instead of flushing them.
+  void Propagate(uint32_t root);
+  // The gradient on this tape of a value that was created outside of it.
+  float BoundGradient(const Value& v) const;
+
+  // Rewrite the tape into an equivalent one with fewer nodes, and return the
+  // new index of each node, or `kDropped` if nothing depends on it anymore.
+  //
+  // All the leaves are constants, except for `variables` and the leaves that
+  // are bound to values created outside of the tape, whose values can change
+  // between passes. Operations over constants are folded into a constant,
+  // operations with a constant operand use their scalar form, identical
+  // operations over the same operands are merged, and nodes that neither
+  // `roots` nor the variables depend on are dropped. The gradients of the
+  // roots and the leaves are unchanged (up to rounding), but the other nodes
+  // may no longer exist.
+  std::vector<uint32_t> Simplify(std::span<const uint32_t> variables,
+                                 std::span<const uint32_t> roots);
+  static constexpr uint32_t kDropped = -1;
+
+  float value(uint32_t index) const { return values_[index]; }
+  void value(uint32_t index, float v) { values_[index] = v; }
+  float grad(uint32_t index) const { return grads_[index]; }
+  void grad(uint32_t index, float v) { grads_[index] = v; }
+
+  // Call `fn(id, op, value, grad, operands)` once for every node that `root`
+  // depends on, in tape order, like `ValueImpl::ForEachNode`: the nodes are
+  // numbered from 0 in that order, and `operands` are the ids of the distinct
+  // operands of the node.
+  template <typename Fn>
+  void ForEachNode(uint32_t root, Fn fn) const;
+
+  // Record an operation, computing its value from its operands.
+  uint32_t Record(Node node);
+  uint32_t Record(Node node, float value);
+  float Evaluate(const Node& node);
+
+  // The indices of the operands of `node`, in order.
+  std::vector<uint32_t> OperandsOf(const Node& node) const;
+  // Record an operation over `operands` (as returned by `OperandsOf`).
+  uint32_t Record(Op op, float arg, std::span<const uint32_t> operands);
+
+  // The values of a list of `n` operands, gathered into `scratch` if they are
+  // not consecutive on the tape.
+  const float* Gather(const uint32_t* operands, uint32_t n, bool contiguous,
+                      std::vector<float>* scratch) const;
+  // Computes grad[operands[i]] += alpha * x[i].
+  void Accumulate(float alpha, const float* x, const uint32_t* operands,
+                  uint32_t n, bool contiguous);
+
+  std::vector<Node> nodes_;
+  std::vector<float> values_;
+  std::vector<float> grads_;
+  // The operand lists of `Op::kDot`, `Op::kSum` and loss function nodes.
+  std::vector<uint32_t> operands_;
+  std::vector<float> scratch_lhs_;
+  std::vector<float> scratch_rhs_;
+  // The gradients of the operands of a loss function.
+  std::vector<float> scratch_gradients_;
+  // Leaves that refer to values that were created outside of this tape.
+  std::vector<std::pair<uint32_t, std::shared_ptr<ValueImpl<float>>>> bindings_;
+  absl::flat_hash_map<const ValueImpl<float>*, uint32_t> bound_;
+};
+
+template <typename Fn>
+void Tape::ForEachNode(uint32_t root, Fn fn) const {
+  // The operands of a node are recorded before it, so a single backward sweep
+  // finds every node `root` depends on.
+  std::vector<bool> reachable(root + 1);
+  reachable[root] = true;
+  for (uint32_t i = root + 1; i-- > 0;) {
+    if (reachable[i]) {
+      for (uint32_t operand : OperandsOf(nodes_[i])) {
+        reachable[operand] = true;
+      }
+    }
+  }
+  std::vector<uint64_t> ids(root + 1);
+  // The last node that listed each node as an operand, plus one.
+  std::vector<uint32_t> seen_by(root + 1);
+  std::vector<uint64_t> operands;
+  uint64_t id = 0;
+  for (uint32_t i = 0; i <= root; ++i) {
+    if (!reachable[i]) {
+      continue;
+    }
+    operands.clear();
+    for (uint32_t operand : OperandsOf(nodes_[i])) {
+      if (seen_by[operand] != i + 1) {
+        seen_by[operand] = i + 1;
+        operands.push_back(ids[operand]);
+      }
+    }
+    ids[i] = id;
+    fn(id++, nodes_[i].op, values_[i], grads_[i],
+       std::span<const uint64_t>(operands));
+  }
+}
+
+}  // namespace micrograd
@@ -0,0 +1,402 @@
+#include "micrograd/tensor.h"
+
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/strings/str_format.h"
+#include "micrograd/kernels.h"
+
+namespace micrograd {
+
+namespace {
+
+// Training on a large batch allocates and frees the same big buffers every
+// step, and faulting in fresh pages for them costs more than the math. So the
+// buffers of freed tensors are kept around (per thread) for the next step.
+class BufferPool {
+ public:
+  // A buffer of `size` floats, with unspecified contents.
+  static std::vector<float> Acquire(size_t size) {
+    auto it = Free().find(size);
+    if (it == Free().end() || it->second.empty()) {
+      return std::vector<float>(size);
+    }
+    std::vector<float> buffer = std::move(it->second.back());
+    it->second.pop_back();
+    return buffer;
+  }
+
+  static void Release(std::vector<float> buffer) {
+    if (!buffer.empty()) {
+      Free()[buffer.size()].push_back(std::move(buffer));
+    }
+  }
+
+ private:
+  static absl::flat_hash_map<size_t, std::vector<std::vector<float>>>& Free() {
+    thread_local absl::flat_hash_map<size_t, std::vector<std::vector<float>>>
+        free;
+    return free;
+  }
+};
+
+}  // namespace
+
+class TensorImpl : public std::enable_shared_from_this<TensorImpl> {
+  using Children = std::vector<std::shared_ptr<TensorImpl>>;
+
+ public:
+  // A leaf tensor.
+  TensorImpl(size_t rows, size_t cols, std::vector<float> values)
+      : rows_(rows),
+        cols_(cols),
+        values_(std::move(values)),
+        grads_(values_.size()) {}
+
+  // The output of an operation, the values are uninitialized and the
+  // gradients are only allocated by `Backward`.
+  TensorImpl(size_t rows, size_t cols, Children children)
+      : rows_(rows),
+        cols_(cols),
+        values_(BufferPool::Acquire(rows * cols)),
+        children_(std::move(children)) {}
+
+  TensorImpl(const TensorImpl&) = delete;
+  TensorImpl& operator=(const TensorImpl&) = delete;
+  ~TensorImpl() {
+    BufferPool::Release(std::move(values_));
+    BufferPool::Release(std::move(grads_));
+  }
+
+  static std::shared_ptr<TensorImpl> FromValues(std::span<const Value> values,
+                                                size_t rows, size_t cols) {
+    std::vector<float> data;
+    data.reserve(values.size());
+    for (const Value& v : values) {
+      data.push_back(v.value());
+    }
+    auto out = std::make_shared<TensorImpl>(rows, cols, std::move(data));
+    out->gathered_ = true;
+    out->backward_ = [values = std::vector<Value>(values.begin(), values.end()),
+                      out = out.get()]() mutable {
+      for (size_t i = 0; i < values.size(); ++i) {
+        values[i].gradient(values[i].gradient() + out->grads_[i]);
+      }
+    };
+    return out;
+  }
+
+  std::shared_ptr<TensorImpl> Matmul(TensorImpl* other) {
+    size_t m = rows_, k = cols_, n = other->cols_;
+    auto out = Output(m, n, {other});
+    std::fill(out->values_.begin(), out->values_.end(), 0.0);
+    for (size_t i = 0; i < m; ++i) {
+      kernels::MatVec(other->values_.data(), &values_[i * k],
+                      &out->values_[i * n], k, n);
+    }
+    out->backward_ = [this, other, out = out.get(), m, k, n] {
+      for (size_t i = 0; i < m; ++i) {
+        const float* grad = &out->grads_[i * n];
+        for (size_t p = 0; p < k; ++p) {
+          grads_[i * k + p] += kernels::Dot(grad, &other->values_[p * n], n);
+        }
+      }
+      kernels::TransposedMatmul(values_.data(), out->grads_.data(),
+                                other->grads_.data(), m, k, n);
+    };
+    return out;
+  }
+
+  std::shared_ptr<TensorImpl> MatmulTransposed(TensorImpl* other) {
+    size_t m = rows_, k = cols_, n = other->rows_;
+    auto out = Output(m, n, {other});
+    // Transposing the (small) weights first lets each output row be computed
+    // as one pass over the rows of the weights.
+    std::vector<float> transposed = Transpose(other->values_, n, k);
+    std::fill(out->values_.begin(), out->values_.end(), 0.0);
+    for (size_t i = 0; i < m; ++i) {
+      kernels::MatVec(transposed.data(), &values_[i * k], &out->values_[i * n],
+                      k, n);
+    }
+    out->backward_ = [this, other, out = out.get(), m, k, n] {
+      for (size_t i = 0; i < m; ++i) {
+        kernels::MatVec(other->values_.data(), &out->grads_[i * n],
+                        &grads_[i * k], n, k);
+      }
+      kernels::TransposedMatmul(out->grads_.data(), values_.data(),
+                                other->grads_.data(), m, n, k);
+    };
+    return out;
+  }
+
+  std::shared_ptr<TensorImpl> AddBias(TensorImpl* bias) {
+    auto out = Output(rows_, cols_, {bias});
+    for (size_t i = 0; i < rows_; ++i) {
+      for (size_t j = 0; j < cols_; ++j) {
+        out->values_[i * cols_ + j] = values_[i * cols_ + j] + bias->values_[j];
+      }
+    }
+    out->backward_ = [this, bias, out = out.get()] {
+      kernels::Axpy(1, out->grads_.data(), grads_.data(), grads_.size());
+      for (size_t i = 0; i < rows_; ++i) {
+        kernels::Axpy(1, &out->grads_[i * cols_], bias->grads_.data(), cols_);
+      }
+    };
+    return out;
+  }
+
+  std::shared_ptr<TensorImpl> Add(TensorImpl* other) {
+    auto out = Output(rows_, cols_, {other});
+    for (size_t i = 0; i < values_.size(); ++i) {
+      out->values_[i] = values_[i] + other->values_[i];
+    }
+    out->backward_ = [this, other, out = out.get()] {
+      kernels::Axpy(1, out->grads_.data(), grads_.data(), grads_.size());
+      kernels::Axpy(1, out->grads_.data(), other->grads_.data(),
+                    other->grads_.size());
+    };
+    return out;
+  }
+
+  std::shared_ptr<TensorImpl> Add(float other) {
+    auto out = Output(rows_, cols_, {});
+    for (size_t i = 0; i < values_.size(); ++i) {
+      out->values_[i] = values_[i] + other;
+    }
+    out->backward_ = [this, out = out.get()] {
+      kernels::Axpy(1, out->grads_.data(), grads_.data(), grads_.size());
+    };
+    return out;
+  }
+
+  std::shared_ptr<TensorImpl> Multiply(TensorImpl* other) {
+    auto out = Output(rows_, cols_, {other});
+    for (size_t i = 0; i < values_.size(); ++i) {
+      out->values_[i] = values_[i] * other->values_[i];
+    }
+    out->backward_ = [this, other, out = out.get()] {
+      for (size_t i = 0; i < values_.size(); ++i) {
+        grads_[i] += other->values_[i] * out->grads_[i];
+        other->grads_[i] += values_[i] * out->grads_[i];
+      }
+    };
+    return out;
+  }
+
+  std::shared_ptr<TensorImpl> Multiply(float other) {
+    auto out = Output(rows_, cols_, {});
+    for (size_t i = 0; i < values_.size(); ++i) {
+      out->values_[i] = values_[i] * other;
+    }
+    out->backward_ = [this, other, out = out.get()] {
+      kernels::Axpy(other, out->grads_.data(), grads_.data(), grads_.size());
+    };
+    return out;
+  }
+
+  std::shared_ptr<TensorImpl> Relu() {
+    auto out = Output(rows_, cols_, {});
+    for (size_t i = 0; i < values_.size(); ++i) {
+      out->values_[i] = values_[i] < 0 ? 0 : values_[i];
+    }
+    out->backward_ = [this, out = out.get()] {
+      for (size_t i = 0; i < values_.size(); ++i) {
+        grads_[i] += out->values_[i] > 0 ? out->grads_[i] : 0;
+      }
+    };
+    return out;
+  }
+
+  std::shared_ptr<TensorImpl> Sum() {
+    auto out = Output(1, 1, {});
+    out->values_[0] = kernels::Sum(values_.data(), values_.size());
+    out->backward_ = [this, out = out.get()] {
+      float grad = out->grads_[0];
+      for (float& g : grads_) {
+        g += grad;
+      }
+    };
+    return out;
+  }
+
+  void Backward() {
+    std::vector<TensorImpl*> order = TopologicalSort();
+    // Only leaves accumulate gradients across backward passes. A tensor
+    // gathered from values flushes its gradient into them on every pass, so
+    // it starts each pass from zero like the other nodes.
+    for (TensorImpl* t : order) {
+      if (!t->children_.empty() || t->gathered_) {
+        if (t->grads_.empty()) {
+          t->grads_ = BufferPool::Acquire(t->values_.size());
+        }
+        std::fill(t->grads_.begin(), t->grads_.end(), 0.0);
+      }
+    }
+    grads_[0] = 1.0;
+    for (ssize_t i = order.size() - 1; i >= 0; --i) {
+      order[i]->backward_();
+    }
+  }
+
+  size_t rows() const { return rows_; }
+  size_t cols() const { return cols_; }
+  std::span<float> values() { return values_; }
+  std::span<const float> grads() const { return grads_; }
+
+ private:
+  // A new tensor that has this tensor and `others` as children.
+  std::shared_ptr<TensorImpl> Output(
+      size_t rows, size_t cols, std::initializer_list<TensorImpl*> others) {
+    Children children = {shared_from_this()};
+    for (TensorImpl* other : others) {
+      children.push_back(other->shared_from_this());
+    }
+    return std::make_shared<TensorImpl>(rows, cols, std::move(children));
+  }
+
+  // Returns the [cols x rows] transpose of a [rows x cols] matrix.
+  static std::vector<float> Transpose(std::span<const float> data,
+                                      size_t rows, size_t cols) {
+    std::vector<float> out(data.size());
+    for (size_t i = 0; i < rows; ++i) {
+      for (size_t j = 0; j < cols; ++j) {
+        out[j * rows + i] = data[i * cols + j];
+      }
+    }
+    return out;
+  }
+
+  // Output all the tensors reachable from this one, children before parents.
+  std::vector<TensorImpl*> TopologicalSort() {
+    std::vector<TensorImpl*> output;
+    absl::flat_hash_set<TensorImpl*> visited = {this};
+    std::vector<std::pair<TensorImpl*, size_t>> stack = {{this, 0}};
+    while (!stack.empty()) {
+      auto& [node, next] = stack.back();
+      if (next == node->children_.size()) {
+        output.push_back(node);
+        stack.pop_back();
+        continue;
+      }
+      TensorImpl* child = node->children_[next++].get();
+      if (visited.insert(child).second) {
+        stack.emplace_back(child, 0);
+      }
+    }
+    return output;
+  }
+
+  friend class Tensor;
+
+  size_t rows_;
+  size_t cols_;
+  std::vector<float> values_;
+  std::vector<float> grads_;
+  Children children_;
+  absl::AnyInvocable<void()> backward_ = [] {};
+  // Whether this is a leaf made by `FromValues`.
+  bool gathered_ = false;
+};
+
+namespace {
+void CheckSameShape(const Tensor& a, const Tensor& b) {
+  if (a.rows() != b.rows() || a.cols() != b.cols()) {
+    throw std::invalid_argument(
+        absl::StrFormat("mismatched tensor shapes: [%d x %d] and [%d x %d]",
+                        a.rows(), a.cols(), b.rows(), b.cols()));
+  }
+}
+}  // namespace
+
+Tensor::Tensor(size_t rows, size_t cols)
+    : Tensor(rows, cols, std::vector<float>(rows * cols)) {}
+
+Tensor::Tensor(size_t rows, size_t cols, std::vector<float> data)
+    : Tensor(std::make_shared<TensorImpl>(rows, cols, std::move(data))) {
+  if (impl_->values_.size() != rows * cols) {
+    throw std::invalid_argument("tensor data does not match its shape");
+  }
+}
+
+Tensor Tensor::FromValues(std::span<const Value> values, size_t rows,
+                          size_t cols) {
+  if (values.size() != rows * cols) {
+    throw std::invalid_argument("tensor data does not match its shape");
+  }
+  return Tensor(TensorImpl::FromValues(values, rows, cols));
+}
+
+size_t Tensor::rows() const { return impl_->rows(); }
+size_t Tensor::cols() const { return impl_->cols(); }
+
+float Tensor::value(size_t row, size_t col) const {
+  return impl_->values()[row * cols() + col];
+}
+std::span<const float> Tensor::values() const { return impl_->values(); }
+std::span<float> Tensor::values() { return impl_->values(); }
+float Tensor::gradient(size_t row, size_t col) const {
+  std::span<const float> grads = impl_->grads();
+  return grads.empty() ? 0.0 : grads[row * cols() + col];
+}
+std::span<const float> Tensor::gradients() const { return impl_->grads(); }
+
+Tensor Tensor::Matmul(const Tensor& other) const {
+  if (cols() != other.rows()) {
+    throw std::invalid_argument(
+        absl::StrFormat("can't multiply [%d x %d] by [%d x %d]", rows(),
+                        cols(), other.rows(), other.cols()));
+  }
+  return Tensor(impl_->Matmul(other.impl_.get()));
+}
+
+Tensor Tensor::MatmulTransposed(const Tensor& other) const {
+  if (cols() != other.cols()) {
+    throw std::invalid_argument(
+        absl::StrFormat("can't multiply [%d x %d] by transposed [%d x %d]",
+                        rows(), cols(), other.rows(), other.cols()));
+  }
+  return Tensor(impl_->MatmulTransposed(other.impl_.get()));
+}
+
+Tensor Tensor::AddBias(const Tensor& bias) const {
+  if (bias.rows() != 1 || bias.cols() != cols()) {
+    throw std::invalid_argument(
+        absl::StrFormat("can't add a [%d x %d] bias to [%d x %d]", bias.rows(),
+                        bias.cols(), rows(), cols()));
+  }
+  return Tensor(impl_->AddBias(bias.impl_.get()));
+}
+
+Tensor Tensor::Add(const Tensor& other) const {
+  CheckSameShape(*this, other);
+  return Tensor(impl_->Add(other.impl_.get()));
+}
+Tensor Tensor::Add(float other) const { return Tensor(impl_->Add(other)); }
+Tensor Tensor::Multiply(const Tensor& other) const {
+  CheckSameShape(*this, other);
+  return Tensor(impl_->Multiply(other.impl_.get()));
+}
+Tensor Tensor::Multiply(float other) const {
+  return Tensor(impl_->Multiply(other));
+}
+Tensor Tensor::Relu() const { return Tensor(impl_->Relu()); }
+Tensor Tensor::Sum() const { return Tensor(impl_->Sum()); }
+Tensor Tensor::Mean() const {
+  return Sum().Multiply(1.0 / float(rows() * cols()));
+}
+
+void Tensor::Backward() {
+  if (rows() != 1 || cols() != 1) {
+    throw std::invalid_argument("backward must start from a [1 x 1] tensor");
+  }
+  impl_->Backward();
+}
+
+Tensor::Tensor(std::shared_ptr<TensorImpl> impl) : impl_(std::move(impl)) {}
+
+}  // namespace micrograd
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "micrograd/micrograd.h"
+
+namespace micrograd {
+
+class TensorImpl;
+
+/**
+ * A two dimensional, contiguous, row-major matrix of floats that can back
+ * propigate.
+ *
+ * Where `Value` builds a node for every scalar operation, a tensor is a single
+ * node for a whole batch, and the heavy operations run as vectorized loops
+ * over contiguous memory.
+ *
+ * Like `Value`, this class is a small wrapper over a shared pointer, so it is
+ * copy-able, but the underlying tensor is still the same.
+ */
+class Tensor {
+ public:
+  // A tensor of zeros.
+  Tensor(size_t rows, size_t cols);
+  // A tensor with `data` in row-major order.
+  Tensor(size_t rows, size_t cols, std::vector<float> data);
+
+  // A tensor gathered from `values` in row-major order.
+  //
+  // On backward, the gradient of each element is accumulated into the
+  // gradient of the value it came from, so a tensor graph can train the
+  // parameters of a model made out of values.
+  static Tensor FromValues(std::span<const Value> values, size_t rows,
+                           size_t cols);
+
+  size_t rows() const;
+  size_t cols() const;
+
+  float value(size_t row, size_t col) const;
+  std::span<const float> values() const;
+  std::span<float> values();
+  // The gradients of a tensor that is the result of an operation are only
+  // available after a backward pass through it.
+  float gradient(size_t row, size_t col) const;
+  std::span<const float> gradients() const;
+
+  // The matrix product of a [m x k] tensor with a [k x n] tensor.
+  Tensor Matmul(const Tensor& other) const;
+  // The matrix product of a [m x k] tensor with the transpose of a [n x k]
+  // tensor. This is the natural layout for the weights of a layer.
+  Tensor MatmulTransposed(const Tensor& other) const;
+  // Add a [1 x n] row to every row of a [m x n] tensor.
+  Tensor AddBias(const Tensor& bias) const;
+
+  // Elementwise operations over tensors of the same shape.
+  Tensor Add(const Tensor& other) const;
+  Tensor Add(float other) const;
+  Tensor Multiply(const Tensor& other) const;
+  Tensor Multiply(float other) const;
+  Tensor Relu() const;
+
+  // Reductions over all elements into a [1 x 1] tensor.
+  Tensor Sum() const;
+  Tensor Mean() const;
+
+  /**
+   * Populate the gradient for this tensor and all it's children.
+   *
+   * This must be a [1 x 1] tensor.
+   */
+  void Backward();
+
+ private:
+  explicit Tensor(std::shared_ptr<TensorImpl> impl);
+
+  std::shared_ptr<TensorImpl> impl_;
+};
+
+}  // namespace micrograd
@@ -0,0 +1,102 @@
+#include "micrograd/tensor.h"
+
+#include <gtest/gtest.h>
+
+#include "micrograd/nn.h"
+
+namespace micrograd {
+
+TEST(MicrogradTensor, Matmul) {
+  auto a = Tensor(2, 3, {1, 2, 3, 4, 5, 6});
+  auto b = Tensor(3, 2, {7, 8, 9, 10, 11, 12});
+  auto c = a.Matmul(b);
+  ASSERT_EQ(c.rows(), 2);
+  ASSERT_EQ(c.cols(), 2);
+  EXPECT_FLOAT_EQ(c.value(0, 0), 58);
+  EXPECT_FLOAT_EQ(c.value(0, 1), 64);
+  EXPECT_FLOAT_EQ(c.value(1, 0), 139);
+  EXPECT_FLOAT_EQ(c.value(1, 1), 154);
+  c.Sum().Backward();
+  // d(sum(a @ b))/da[i][k] = sum_j b[k][j]
+  EXPECT_FLOAT_EQ(a.gradient(0, 0), 15);
+  EXPECT_FLOAT_EQ(a.gradient(1, 2), 23);
+  // d(sum(a @ b))/db[k][j] = sum_i a[i][k]
+  EXPECT_FLOAT_EQ(b.gradient(0, 1), 5);
+  EXPECT_FLOAT_EQ(b.gradient(2, 0), 9);
+}
+
+TEST(MicrogradTensor, MatchesValues) {
+  std::vector<float> data = {-1.5, 0.25, 2, 3, -0.5, 1, 0.75, -2};
+  std::vector<Value> values;
+  for (float f : data) {
+    values.push_back(Value(f));
+  }
+  auto w = Tensor::FromValues(values, 4, 2);
+  auto x = Tensor(3, 2, {1, 2, -3, 4, 0.5, -1});
+  auto bias = Tensor(1, 4, {0.1, -0.2, 0.3, -0.4});
+  auto loss = x.MatmulTransposed(w).AddBias(bias).Relu().Mean();
+  loss.Backward();
+
+  Value expected = Value(0.0);
+  for (size_t i = 0; i < x.rows(); ++i) {
+    for (size_t j = 0; j < w.rows(); ++j) {
+      Value v = Value(bias.value(0, j));
+      for (size_t k = 0; k < x.cols(); ++k) {
+        v = v.Add(values[j * 2 + k].Multiply(x.value(i, k)));
+      }
+      expected = expected.Add(v.Relu());
+    }
+  }
+  expected = expected.Divide(12);
+  // Keep the gradients from the tensor graph to compare against.
+  std::vector<float> gradients;
+  for (Value& v : values) {
+    gradients.push_back(v.gradient());
+    v.gradient(0);
+  }
+  expected.Backward();
+  EXPECT_FLOAT_EQ(loss.value(0, 0), expected.value());
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_FLOAT_EQ(gradients[i], values[i].gradient());
+  }
+}
+
+TEST(MicrogradTensor, RepeatedBackward) {
+  auto w = Value(2);
+  auto loss = Tensor::FromValues(std::vector<Value>{w}, 1, 1).Multiply(3).Sum();
+  loss.Backward();
+  loss.Backward();
+  // Each pass adds its gradient to the value once, like the heap engine.
+  EXPECT_FLOAT_EQ(w.gradient(), 6);
+  Value expected = w.Multiply(3);
+  w.gradient(0);
+  expected.Backward();
+  expected.Backward();
+  EXPECT_FLOAT_EQ(w.gradient(), 6);
+}
+
+TEST(MicrogradTensor, BatchedMLP) {
+  auto model = MLP(3, std::vector<size_t>{4, 4, 1});
+  auto x = Tensor(2, 3, {2, 3, -1, 3, -1, 0.5});
+  Tensor batched = model(x);
+  ASSERT_EQ(batched.rows(), 2);
+  ASSERT_EQ(batched.cols(), 1);
+  for (size_t i = 0; i < x.rows(); ++i) {
+    std::vector<Value> inputs;
+    for (size_t k = 0; k < x.cols(); ++k) {
+      inputs.push_back(Value(x.value(i, k)));
+    }
+    // The batched kernels sum in a different order than a dot product.
+    EXPECT_NEAR(batched.value(i, 0), model(inputs).front().value(), 1e-5);
+  }
+}
+
+TEST(MicrogradTensor, MismatchedShapes) {
+  auto a = Tensor(2, 3);
+  auto b = Tensor(2, 3);
+  EXPECT_THROW(a.Matmul(b), std::invalid_argument);
+  EXPECT_THROW(a.Add(Tensor(3, 2)), std::invalid_argument);
+  EXPECT_THROW(a.Backward(), std::invalid_argument);
+}
+
+}  // namespace micrograd
@@ -0,0 +1,93 @@
+#include "micrograd/thread_pool.h"
+
+#include <atomic>
+#include <exception>
+
+namespace micrograd {
+
+struct ThreadPool::Job {
+  absl::FunctionRef<void(size_t)> fn;
+  size_t n;
+  std::atomic<size_t> next = 0;
+  // The number of workers that are still running this job, guarded by the
+  // mutex of the pool.
+  size_t running = 0;
+  std::once_flag error_once;
+  std::exception_ptr error;
+};
+
+ThreadPool::ThreadPool(size_t threads) {
+  for (size_t i = 1; i < threads; ++i) {
+    workers_.emplace_back([this] { Work(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mu_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t n, absl::FunctionRef<void(size_t)> fn) {
+  Job job{.fn = fn, .n = n};
+  if (workers_.empty() || n <= 1) {
+    Run(&job);
+  } else {
+    {
+      std::lock_guard lock(mu_);
+      job_ = &job;
+      ++generation_;
+    }
+    wake_.notify_all();
+    Run(&job);
+    // Workers may still hold on to the job, even when there is nothing left
+    // for them to do, so wait for all of them to let go of it.
+    std::unique_lock lock(mu_);
+    job_ = nullptr;
+    done_.wait(lock, [&job] { return job.running == 0; });
+  }
+  if (job.error) {
+    std::rethrow_exception(job.error);
+  }
+}
+
+void ThreadPool::Work() {
+  uint64_t generation = 0;
+  std::unique_lock lock(mu_);
+  while (true) {
+    wake_.wait(lock, [this, generation] {
+      return stopping_ || (job_ != nullptr && generation_ != generation);
+    });
+    if (stopping_) {
+      return;
+    }
+    generation = generation_;
+    Job* job = job_;
+    ++job->running;
+    lock.unlock();
+    Run(job);
+    lock.lock();
+    if (--job->running == 0) {
+      done_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::Run(Job* job) {
+  size_t i;
+  while ((i = job->next.fetch_add(1, std::memory_order_relaxed)) < job->n) {
+    try {
+      job->fn(i);
+    } catch (...) {
+      std::call_once(job->error_once,
+                     [job] { job->error = std::current_exception(); });
+    }
+  }
+}
+
+}  // namespace micrograd
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+
+namespace micrograd {
+
+/**
+ * A fixed set of worker threads for running loops in parallel.
+ *
+ * The threads are started once and reused, so a parallel loop only costs a
+ * wake up instead of creating a thread for every step of training.
+ */
+class ThreadPool {
+ public:
+  // A pool that runs loops over `threads` threads, including the calling
+  // thread, so a pool of one thread runs everything inline.
+  explicit ThreadPool(size_t threads);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  // Call `fn(i)` for every `i` in [0, n) across the threads of the pool, and
+  // wait for all the calls to finish. The order of the calls is unspecified.
+  //
+  // If any call throws, the first exception is rethrown from here once the
+  // other calls have finished.
+  void ParallelFor(size_t n, absl::FunctionRef<void(size_t)> fn);
+
+  // The number of threads loops run on.
+  size_t size() const { return workers_.size() + 1; }
+
+ private:
+  struct Job;
+
+  void Work();
+  static void Run(Job* job);
+
+  std::mutex mu_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  Job* job_ = nullptr;
+  uint64_t generation_ = 0;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace micrograd
@@ -0,0 +1,42 @@
+#include "micrograd/thread_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+
+namespace micrograd {
+
+TEST(MicrogradThreadPool, ParallelFor) {
+  for (size_t threads : {1, 2, 5}) {
+    ThreadPool pool(threads);
+    EXPECT_EQ(pool.size(), threads);
+    for (size_t n : {0, 1, 7, 1000}) {
+      std::vector<std::atomic<int>> calls(n);
+      pool.ParallelFor(n, [&](size_t i) { calls[i].fetch_add(1); });
+      for (size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(calls[i].load(), 1);
+      }
+    }
+  }
+}
+
+TEST(MicrogradThreadPool, Exception) {
+  ThreadPool pool(3);
+  std::atomic<size_t> calls = 0;
+  EXPECT_THROW(pool.ParallelFor(100,
+                                [&](size_t i) {
+                                  calls.fetch_add(1);
+                                  if (i == 42) {
+                                    throw std::runtime_error("oops");
+                                  }
+                                }),
+               std::runtime_error);
+  // The other calls still run.
+  EXPECT_EQ(calls.load(), 100);
+  // And the pool is still usable.
+  pool.ParallelFor(10, [&](size_t) { calls.fetch_add(1); });
+  EXPECT_EQ(calls.load(), 110);
+}
+
+}  // namespace micrograd
@@ -0,0 +1,590 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/functional/any_invocable.h"
+#include "micrograd/instrumentation.h"
+#include "micrograd/scalar.h"
+#include "micrograd/thread_pool.h"
+
+namespace micrograd {
+
+// The operation that produced a node in the expression graph.
+enum class Op : char {
+  kNone = ' ',
+  kAdd = '+',
+  kSubtract = '-',
+  kMultiply = '*',
+  kDivide = '/',
+  kNegate = '~',
+  // The scalar forms of `kAdd` and `kMultiply`, whose second operand is a
+  // constant stored in the node instead of a leaf.
+  kAddConstant = 'A',
+  kMultiplyConstant = 'M',
+  kPow = '^',
+  kReLU = '?',
+  kDot = '.',
+  kSum = 'S',
+  // Loss functions over a list of predictions and a list of targets.
+  kHinge = 'H',
+  kMeanSquaredError = 'E',
+  kSoftmaxCrossEntropy = 'X',
+};
+
+// A heap allocated node in the expression graph, holding a value and a
+// gradient of type `T`.
+//
+// This is an implementation detail of `BasicValue` and `Tape`, and should not
+// be used directly.
+template <Scalar T>
+class ValueImpl : public std::enable_shared_from_this<ValueImpl<T>> {
+  using ChildrenSet = absl::flat_hash_set<std::shared_ptr<ValueImpl>>;
+  using std::enable_shared_from_this<ValueImpl>::shared_from_this;
+
+ public:
+  ValueImpl(T val) : data_{val, 0.0f} { MICROGRAD_NODE_CREATED(Bytes()); }
+  ValueImpl(T val, ChildrenSet children, Op op)
+      : data_{val, 0.0f}, children_(children), op_(op) {
+    MICROGRAD_NODE_CREATED(Bytes());
+  }
+  // A leaf whose value and gradient are stored outside of the node, in
+  // `storage`, such as the contiguous arrays of a `ParameterBuffer`. The node
+  // shares ownership of the storage, so it outlives the buffer if need be.
+  ValueImpl(std::shared_ptr<T[]> storage, T* value, T* grad)
+      : value_(value), grad_(grad), storage_(std::move(storage)) {
+    MICROGRAD_NODE_CREATED(Bytes());
+  }
+  ValueImpl(const ValueImpl&) = delete;
+  ValueImpl& operator=(const ValueImpl&) = delete;
+  ~ValueImpl() {
+    MICROGRAD_NODE_DESTROYED(Bytes());
+    Release(std::move(children_));
+  }
+
+  std::shared_ptr<ValueImpl> Add(std::shared_ptr<ValueImpl> other) {
+    auto out = std::make_shared<ValueImpl>(
+        *value_ + *other->value_, ChildrenSet({shared_from_this(), other}),
+        Op::kAdd);
+    out->backward_ = [this, other = other.get(), out = out.get()] {
+      Accumulate(this, *out->grad_);
+      Accumulate(other, *out->grad_);
+    };
+    return out;
+  }
+
+  std::shared_ptr<ValueImpl> Subtract(std::shared_ptr<ValueImpl> other) {
+    auto out = std::make_shared<ValueImpl>(
+        *value_ - *other->value_, ChildrenSet({shared_from_this(), other}),
+        Op::kSubtract);
+    out->backward_ = [this, other = other.get(), out = out.get()] {
+      Accumulate(this, *out->grad_);
+      Accumulate(other, -*out->grad_);
+    };
+    return out;
+  }
+
+  std::shared_ptr<ValueImpl> AddConstant(T other) {
+    auto out = std::make_shared<ValueImpl>(
+        *value_ + other, ChildrenSet({shared_from_this()}), Op::kAddConstant);
+    out->backward_ = [this, out = out.get()] {
+      Accumulate(this, *out->grad_);
+    };
+    return out;
+  }
+
+  std::shared_ptr<ValueImpl> Multiply(std::shared_ptr<ValueImpl> other) {
+    auto out = std::make_shared<ValueImpl>(
+        *value_ * *other->value_, ChildrenSet({shared_from_this(), other}),
+        Op::kMultiply);
+    out->backward_ = [this, other = other.get(), out = out.get()] {
+      Accumulate(this, *other->value_ * *out->grad_);
+      Accumulate(other, *this->value_ * *out->grad_);
+    };
+    return out;
+  }
+
+  std::shared_ptr<ValueImpl> Divide(std::shared_ptr<ValueImpl> other) {
+    auto out = std::make_shared<ValueImpl>(
+        *value_ / *other->value_, ChildrenSet({shared_from_this(), other}),
+        Op::kDivide);
+    // d(a / b)/db is -(a / b) / b.
+    out->backward_ = [this, other = other.get(), out = out.get()] {
+      Accumulate(this, *out->grad_ / *other->value_);
+      Accumulate(other, -(*out->value_ / *other->value_) * *out->grad_);
+    };
+    return out;
+  }
+
+  std::shared_ptr<ValueImpl> MultiplyConstant(T other) {
+    auto out = std::make_shared<ValueImpl>(*value_ * other,
+                                           ChildrenSet({shared_from_this()}),
+                                           Op::kMultiplyConstant);
+    out->backward_ = [this, other, out = out.get()] {
+      Accumulate(this, other * *out->grad_);
+    };
+    return out;
+  }
+
+  std::shared_ptr<ValueImpl> Negate() {
+    auto out = std::make_shared<ValueImpl>(
+        -*value_, ChildrenSet({shared_from_this()}), Op::kNegate);
+    out->backward_ = [this, out = out.get()] {
+      Accumulate(this, -*out->grad_);
+    };
+    return out;
+  }
+
+  std::shared_ptr<ValueImpl> Pow(T other) {
+    auto out = std::make_shared<ValueImpl>(
+        Power(*value_, other), ChildrenSet({shared_from_this()}), Op::kPow);
+    out->backward_ = [this, other, out = out.get()] {
+      Accumulate(this, (other * Power(*value_, other - 1)) * *out->grad_);
+    };
+    return out;
+  }
+
+  std::shared_ptr<ValueImpl> Relu() {
+    auto out = std::make_shared<ValueImpl>(
+        *value_ < 0 ? T(0) : *value_, ChildrenSet({shared_from_this()}),
+        Op::kReLU);
+    out->backward_ = [this, out = out.get()] {
+      Accumulate(this, *out->value_ > 0 ? *out->grad_ : T(0));
+    };
+    return out;
+  }
+
+  // The dot product of the first and second half of `operands`.
+  static std::shared_ptr<ValueImpl> Dot(
+      std::span<const std::shared_ptr<ValueImpl>> operands) {
+    size_t n = operands.size() / 2;
+    std::vector<ValueImpl*> raw = Raw(operands);
+    const T* values = Gather(raw);
+    auto out = std::make_shared<ValueImpl>(
+        scalar::Dot(values, values + n, n),
+        ChildrenSet(operands.begin(), operands.end()), Op::kDot);
+    out->backward_ = [operands = std::move(raw), out = out.get(), n] {
+      T grad = *out->grad_;
+      for (size_t i = 0; i < n; ++i) {
+        ValueImpl* w = operands[i];
+        ValueImpl* x = operands[n + i];
+        Accumulate(w, *x->value_ * grad);
+        Accumulate(x, *w->value_ * grad);
+      }
+    };
+    return out;
+  }
+
+  static std::shared_ptr<ValueImpl> Sum(
+      std::span<const std::shared_ptr<ValueImpl>> operands) {
+    std::vector<ValueImpl*> raw = Raw(operands);
+    auto out = std::make_shared<ValueImpl>(
+        scalar::Sum(Gather(raw), raw.size()),
+        ChildrenSet(operands.begin(), operands.end()), Op::kSum);
+    out->backward_ = [operands = std::move(raw), out = out.get()] {
+      for (ValueImpl* v : operands) {
+        Accumulate(v, *out->grad_);
+      }
+    };
+    return out;
+  }
+
+  // A loss function (`op`) of the predictions in the first half of
+  // `operands` and the targets in the second half. The predictions of
+  // `Op::kSoftmaxCrossEntropy` are rows of `classes` logits.
+  static std::shared_ptr<ValueImpl> Loss(
+      Op op, size_t classes,
+      std::span<const std::shared_ptr<ValueImpl>> operands) {
+    size_t n = operands.size() / 2;
+    std::vector<ValueImpl*> raw = Raw(operands);
+    const T* values = Gather(raw);
+    T loss;
+    switch (op) {
+      case Op::kHinge:
+        loss = scalar::Hinge(values, values + n, n);
+        break;
+      case Op::kMeanSquaredError:
+        loss = scalar::MeanSquaredError(values, values + n, n);
+        break;
+      default:  // Op::kSoftmaxCrossEntropy
+        loss = scalar::SoftmaxCrossEntropy(values, values + n, n, classes);
+        break;
+    }
+    auto out = std::make_shared<ValueImpl>(
+        loss, ChildrenSet(operands.begin(), operands.end()), op);
+    out->backward_ = [op, classes, operands = std::move(raw), out = out.get(),
+                      n] {
+      const T* values = Gather(operands);
+      thread_local std::vector<T> gradients;
+      gradients.resize(2 * n);
+      T* dp = gradients.data();
+      switch (op) {
+        case Op::kHinge:
+          scalar::HingeGradient(values, values + n, n, dp, dp + n);
+          break;
+        case Op::kMeanSquaredError:
+          scalar::MeanSquaredErrorGradient(values, values + n, n, dp, dp + n);
+          break;
+        default:  // Op::kSoftmaxCrossEntropy
+          scalar::SoftmaxCrossEntropyGradient(values, values + n, n, classes,
+                                              dp, dp + n);
+          break;
+      }
+      T grad = *out->grad_;
+      for (size_t i = 0; i < 2 * n; ++i) {
+        Accumulate(operands[i], gradients[i] * grad);
+      }
+    };
+    return out;
+  }
+
+  // Back propagate from this node. Unless `retain_graph`, the backward
+  // function and the children of each node below this one are released as
+  // soon as its gradient has been propagated, see `BasicValue::Backward`.
+  void Backward(bool retain_graph) {
+    SortCached();
+    // Only leaves accumulate gradients across backward passes.
+    for (ValueImpl* v : topological_order_) {
+      if (!v->children_.empty()) {
+        *v->grad_ = 0.0;
+      }
+    }
+    std::vector<std::shared_ptr<ValueImpl>> owned;
+    if (!retain_graph) {
+      owned = Own(topological_order_);
+    }
+    *grad_ = 1.0;
+    for (ssize_t i = topological_order_.size() - 1; i >= 0; --i) {
+      ValueImpl* v = topological_order_[i];
+      v->backward_();
+      // Its parents were all visited before it, so nothing in the graph
+      // needs this node anymore. This node is released last, as the loop
+      // walks its order.
+      if (!retain_graph && v != this) {
+        v->ReleaseGraph();
+        owned[i].reset();
+      }
+    }
+    if (!retain_graph) {
+      ReleaseRoot();
+    }
+  }
+
+  // The same as `Backward`, but the nodes at each depth of the graph (the
+  // length of the longest path to them from this node) are back propagated
+  // concurrently on `pool`.
+  //
+  // All the parents of a node are at a smaller depth, so a node's gradient is
+  // complete once the depths before it are done. While a depth runs, each
+  // chunk of its nodes accumulates into its own buffer of partial gradients,
+  // and a node sums the partials of all the chunks (in a fixed order) before
+  // running its backward function, so there are no races and the result does
+  // not depend on scheduling.
+  void Backward(ThreadPool& pool, bool retain_graph) {
+    SortCached();
+    if (levels_.empty()) {
+      Levelize();
+    }
+    std::vector<std::shared_ptr<ValueImpl>> owned;
+    if (!retain_graph) {
+      owned = Own(level_order_);
+    }
+    size_t n = level_order_.size();
+    for (size_t i = 0; i < n; ++i) {
+      level_order_[i]->slot_ = i;
+    }
+    size_t chunks = pool.size();
+    std::vector<T> partials(chunks * n, 0.0f);
+    partials[slot_] = 1.0;
+    for (size_t level = 0; level + 1 < levels_.size(); ++level) {
+      size_t begin = levels_[level];
+      size_t size = levels_[level + 1] - begin;
+      // Don't bother waking up the pool for a handful of nodes.
+      constexpr size_t kMinChunkSize = 32;
+      size_t level_chunks =
+          std::min(chunks, (size + kMinChunkSize - 1) / kMinChunkSize);
+      pool.ParallelFor(level_chunks, [&](size_t chunk) {
+        sink_ = &partials[chunk * n];
+        for (size_t i = begin + size * chunk / level_chunks;
+             i < begin + size * (chunk + 1) / level_chunks; ++i) {
+          ValueImpl* v = level_order_[i];
+          Accumulator<T> grad = 0.0;
+          for (size_t c = 0; c < chunks; ++c) {
+            grad += partials[c * n + i];
+          }
+          // Only leaves accumulate gradients across backward passes.
+          bool leaf = v->children_.empty() && v != this;
+          *v->grad_ = leaf ? *v->grad_ + grad : grad;
+          v->backward_();
+        }
+        sink_ = nullptr;
+      });
+      if (!retain_graph) {
+        for (size_t i = begin; i < begin + size; ++i) {
+          if (level_order_[i] != this) {
+            level_order_[i]->ReleaseGraph();
+            owned[i].reset();
+          }
+        }
+      }
+    }
+    if (!retain_graph) {
+      ReleaseRoot();
+    }
+  }
+
+  // Where the value and gradient of this node are stored.
+  T* value_data() const { return value_; }
+  T* grad_data() const { return grad_; }
+
+  T value() const { return *value_; }
+  void value(T v) { *value_ = v; }
+  T grad() const { return *grad_; }
+  void grad(T v) { *grad_ = v; }
+
+  // Call `fn(id, op, value, grad, children)` once for every node reachable
+  // from this one, children before parents. The nodes are numbered from 0 in
+  // that order, so this node is numbered last, and `children` are the ids of
+  // the distinct children of the node.
+  template <typename Fn>
+  void ForEachNode(Fn fn) {
+    std::vector<ValueImpl*> order;
+    TopologicalSort(&order);
+    std::vector<uint64_t> children;
+    for (size_t i = 0; i < order.size(); ++i) {
+      ValueImpl* v = order[i];
+      // The children of a node come before it, so they are already numbered.
+      v->slot_ = i;
+      children.clear();
+      for (const auto& child : v->children_) {
+        children.push_back(child->slot_);
+      }
+      fn(uint64_t{i}, v->op_, *v->value_, *v->grad_,
+         std::span<const uint64_t>(children));
+    }
+  }
+
+ private:
+  // Roughly the memory held by this node, for instrumentation. This only
+  // changes when `ReleaseGraph` drops the children, which reports the
+  // difference, so the gauges balance when the node is destroyed.
+  size_t Bytes() const {
+    return sizeof(ValueImpl) +
+           children_.capacity() * sizeof(std::shared_ptr<ValueImpl>);
+  }
+
+  static std::vector<ValueImpl*> Raw(
+      std::span<const std::shared_ptr<ValueImpl>> operands) {
+    std::vector<ValueImpl*> raw;
+    raw.reserve(operands.size());
+    for (const auto& v : operands) {
+      raw.push_back(v.get());
+    }
+    return raw;
+  }
+
+  // Copy the values of `operands` into a contiguous buffer, which is valid
+  // until the next call on this thread.
+  static const T* Gather(std::span<ValueImpl* const> operands) {
+    thread_local std::vector<T> buffer;
+    buffer.clear();
+    for (const ValueImpl* v : operands) {
+      buffer.push_back(*v->value_);
+    }
+    return buffer.data();
+  }
+
+  // Destroy `children`, without recursing into the destructors of nodes that
+  // are only owned by them.
+  //
+  // Every node owns its children, so destroying the root of a long chain
+  // would otherwise destroy the whole chain recursively, and overflow the
+  // stack. Instead, a node that is destroyed while the children of another
+  // one are being released only queues its own children, and the outermost
+  // call releases the queue one set of children at a time.
+  static void Release(ChildrenSet children) {
+    if (children.empty()) {
+      return;
+    }
+    thread_local std::vector<ChildrenSet> pending;
+    thread_local bool releasing = false;
+    pending.push_back(std::move(children));
+    if (releasing) {
+      return;
+    }
+    releasing = true;
+    while (!pending.empty()) {
+      ChildrenSet next = std::move(pending.back());
+      pending.pop_back();
+      // `next` is destroyed here, which may queue more children.
+    }
+    releasing = false;
+  }
+
+  // Drop the backward function and the children of this node once its
+  // gradient has been propagated, so it becomes a leaf with its current
+  // value and gradient.
+  void ReleaseGraph() {
+    if (children_.empty()) {
+      return;
+    }
+    [[maybe_unused]] size_t bytes = Bytes();
+    backward_ = [] {};
+    Release(std::move(children_));
+    children_ = ChildrenSet();
+    MICROGRAD_NODE_SHRUNK(bytes - Bytes());
+    // The cached orders point into the released graph.
+    topological_order_ = {};
+    level_order_ = {};
+    levels_ = {};
+  }
+
+  // Release the graph of the root of a backward pass, once all the nodes
+  // below it have been released.
+  void ReleaseRoot() {
+    ReleaseGraph();
+    // Other roots may share some of the released nodes, and their cached
+    // orders can't be cleared from here.
+    releases_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Sort the nodes reachable from this one into `topological_order_`, unless
+  // it was already sorted and no graph has been released since. Otherwise
+  // the graph below a node never changes once it's created, so the order
+  // only needs to be computed the first time.
+  void SortCached() {
+    uint64_t releases = releases_.load(std::memory_order_relaxed);
+    if (!topological_order_.empty() && sorted_at_release_ == releases) {
+      return;
+    }
+    topological_order_.clear();
+    level_order_.clear();
+    levels_.clear();
+    TopologicalSort(&topological_order_);
+    sorted_at_release_ = releases;
+  }
+
+  // Shared ownership of each of `nodes`, so that releasing the graph while
+  // walking it never destroys a node that is still to be visited.
+  static std::vector<std::shared_ptr<ValueImpl>> Own(
+      std::span<ValueImpl* const> nodes) {
+    std::vector<std::shared_ptr<ValueImpl>> owned;
+    owned.reserve(nodes.size());
+    for (ValueImpl* v : nodes) {
+      owned.push_back(v->shared_from_this());
+    }
+    return owned;
+  }
+
+  // Add `grad` to the gradient of `v`, or to its slot in the buffer of
+  // partial gradients during a parallel backward pass.
+  static void Accumulate(ValueImpl* v, T grad) {
+    if (sink_ != nullptr) {
+      sink_[v->slot_] += grad;
+    } else {
+      *v->grad_ += grad;
+    }
+  }
+
+  // Group the nodes reachable from this one by their depth, for the parallel
+  // backward pass.
+  void Levelize() {
+    // Parents come after their children in the topological order, so
+    // walking it backwards finalizes the depth of a node before its children
+    // are updated.
+    for (ValueImpl* v : topological_order_) {
+      v->slot_ = 0;
+    }
+    size_t depth = 0;
+    for (size_t i = topological_order_.size(); i-- > 0;) {
+      ValueImpl* v = topological_order_[i];
+      depth = std::max<size_t>(depth, v->slot_);
+      for (const auto& child : v->children_) {
+        child->slot_ = std::max(child->slot_, v->slot_ + 1);
+      }
+    }
+    // Counting sort by depth.
+    levels_.assign(depth + 2, 0);
+    for (ValueImpl* v : topological_order_) {
+      ++levels_[v->slot_ + 1];
+    }
+    for (size_t i = 1; i < levels_.size(); ++i) {
+      levels_[i] += levels_[i - 1];
+    }
+    level_order_.resize(topological_order_.size());
+    std::vector<uint32_t> next(levels_.begin(), levels_.end() - 1);
+    for (ValueImpl* v : topological_order_) {
+      level_order_[next[v->slot_]++] = v;
+    }
+  }
+
+  // `base` to the power of `exponent`, computed in the accumulator type so
+  // that 16-bit values are only rounded once.
+  static T Power(T base, T exponent) {
+    return std::pow(Accumulator<T>(base), Accumulator<T>(exponent));
+  }
+
+  // Output all the nodes reachable from this one, children before parents.
+  //
+  // This is a depth first search with an explicit stack, so that deep graphs
+  // don't overflow the call stack. Instead of a visited set, nodes are marked
+  // with the epoch of the search that last visited them.
+  void TopologicalSort(std::vector<ValueImpl*>* output) {
+    MICROGRAD_TRACE_SCOPE("TopologicalSort");
+    uint64_t epoch = epochs_.fetch_add(1, std::memory_order_relaxed) + 1;
+    std::vector<std::pair<ValueImpl*, typename ChildrenSet::const_iterator>>
+        stack;
+    visited_epoch_ = epoch;
+    stack.emplace_back(this, children_.begin());
+    while (!stack.empty()) {
+      auto& [node, it] = stack.back();
+      if (it == node->children_.end()) {
+        output->push_back(node);
+        stack.pop_back();
+        continue;
+      }
+      ValueImpl* child = (it++)->get();
+      if (child->visited_epoch_ != epoch) {
+        child->visited_epoch_ = epoch;
+        stack.emplace_back(child, child->children_.begin());
+      }
+    }
+  }
+
+  inline static std::atomic<uint64_t> epochs_ = 0;
+  // The number of backward passes that released their graph so far.
+  inline static std::atomic<uint64_t> releases_ = 0;
+  // Where `Accumulate` adds gradients to on this thread, if anywhere.
+  inline static thread_local T* sink_ = nullptr;
+
+  // The value and gradient of this node, which point at `data_` unless they
+  // are stored outside of the node.
+  T data_[2] = {0.0f, 0.0f};
+  T* value_ = &data_[0];
+  T* grad_ = &data_[1];
+  // Owns what `value_` and `grad_` point into, when it is not `data_`.
+  std::shared_ptr<T[]> storage_;
+  absl::flat_hash_set<std::shared_ptr<ValueImpl>> children_;
+  absl::AnyInvocable<void()> backward_ = [] {};
+  Op op_ = Op::kNone;
+  uint64_t visited_epoch_ = 0;
+  std::vector<ValueImpl*> topological_order_;
+  // The value of `releases_` when `topological_order_` was computed.
+  uint64_t sorted_at_release_ = 0;
+  // The index of this node in the current parallel backward pass (or its
+  // depth while computing levels, or its id in `ForEachNode`).
+  uint32_t slot_ = 0;
+  // The nodes reachable from this one sorted by depth, and the offset of
+  // each depth in that order (with the total at the end).
+  std::vector<ValueImpl*> level_order_;
+  std::vector<uint32_t> levels_;
+};
+
+}  // namespace micrograd